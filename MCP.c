@@ -0,0 +1,475 @@
+// ./MCP.c
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Number of tasks allocated at a time by the task table
+#define TASK_CHUNK_SIZE 1024
+
+// Initial number of pid hash buckets, always a power of two
+#define INITIAL_BUCKETS 64
+
+
+// Signatures
+
+// Returns the bucket index of 'pid' in a table with 'num_buckets' buckets
+static int pid_bucket(pid_t pid, int num_buckets);
+
+// Doubles the number of pid hash buckets and rehashes the live tasks
+static void grow_buckets(task_table* table);
+
+// Moves the task at 'i' towards the root until its parent comes before it
+static void sift_up(task_heap* h, int i);
+
+// Moves the task at 'i' towards the leaves until it comes before its children
+static void sift_down(task_heap* h, int i);
+
+// Puts 't' at position 'i' of the heap
+static void heap_place(task_heap* h, int i, task* t);
+
+
+// Run queue
+
+void rq_init(run_queue* rq) {
+  rq->head = NULL;
+  rq->size = 0;
+}
+
+
+void rq_push(run_queue* rq, task* t) {
+  if (rq->head == NULL) {
+    t->rq_next = t;
+    t->rq_prev = t;
+    rq->head = t;
+  }
+  else {
+    // the tail is just before the head
+    task* tail = rq->head->rq_prev;
+    t->rq_next = rq->head;
+    t->rq_prev = tail;
+    tail->rq_next = t;
+    rq->head->rq_prev = t;
+  }
+  ++rq->size;
+}
+
+
+void rq_push_front(run_queue* rq, task* t) {
+  // in a circular list the new tail becomes the head by moving the head back
+  rq_push(rq, t);
+  rq->head = t;
+}
+
+
+task* rq_pop(run_queue* rq) {
+  task* t = rq->head;
+  if (t != NULL) {
+    rq_remove(rq, t);
+  }
+  return t;
+}
+
+
+void rq_remove(run_queue* rq, task* t) {
+  if (t->rq_next == t) {
+    // last task in the queue
+    rq->head = NULL;
+  }
+  else {
+    t->rq_prev->rq_next = t->rq_next;
+    t->rq_next->rq_prev = t->rq_prev;
+    if (rq->head == t) {
+      rq->head = t->rq_next;
+    }
+  }
+  t->rq_next = NULL;
+  t->rq_prev = NULL;
+  --rq->size;
+}
+
+
+int rq_queued(task* t) {
+  return t->rq_next != NULL || t->heap_index != -1;
+}
+
+
+void rq_splice(run_queue* dst, run_queue* src) {
+  if (src->head == NULL) {
+    return;
+  }
+  if (dst->head == NULL) {
+    dst->head = src->head;
+  }
+  else {
+    // join dst tail -> src head and src tail -> dst head
+    task* dst_tail = dst->head->rq_prev;
+    task* src_tail = src->head->rq_prev;
+    dst_tail->rq_next = src->head;
+    src->head->rq_prev = dst_tail;
+    src_tail->rq_next = dst->head;
+    dst->head->rq_prev = src_tail;
+  }
+  dst->size += src->size;
+  rq_init(src);
+}
+
+
+task* rq_first_allowed(run_queue* rq, int cpu) {
+  task* t = rq->head;
+  for (int i = 0; i < rq->size; ++i, t = t->rq_next) {
+    if (task_allowed(t, cpu)) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+
+// Task heap
+
+void heap_init(task_heap* h, int (*before)(task* a, task* b)) {
+  h->tasks = NULL;
+  h->size = 0;
+  h->cap = 0;
+  h->before = before;
+}
+
+
+void heap_push(task_heap* h, task* t) {
+  if (h->size == h->cap) {
+    int cap = h->cap == 0 ? 64 : h->cap * 2;
+    task** tasks = realloc(h->tasks, sizeof(task*) * cap);
+    if (tasks == NULL) {
+      fprintf(stderr, "task heap allocation failed\n");
+      exit(-1);
+    }
+    h->tasks = tasks;
+    h->cap = cap;
+  }
+  heap_place(h, h->size++, t);
+  sift_up(h, t->heap_index);
+}
+
+
+void heap_remove(task_heap* h, task* t) {
+  int i = t->heap_index;
+  task* last = h->tasks[--h->size];
+  t->heap_index = -1;
+  if (last == t) {
+    return;
+  }
+
+  // the last task fills the hole and moves whichever way restores order
+  heap_place(h, i, last);
+  sift_up(h, i);
+  sift_down(h, last->heap_index);
+}
+
+
+task* heap_pop_allowed(task_heap* h, int cpu) {
+  if (h->size == 0) {
+    return NULL;
+  }
+
+  // the root is the answer unless it is pinned to other CPUs, then the
+  // best allowed task has to be searched for
+  task* best = h->tasks[0];
+  if (!task_allowed(best, cpu)) {
+    best = NULL;
+    for (int i = 1; i < h->size; ++i) {
+      task* t = h->tasks[i];
+      if (task_allowed(t, cpu) && (best == NULL || h->before(t, best))) {
+        best = t;
+      }
+    }
+    if (best == NULL) {
+      return NULL;
+    }
+  }
+  heap_remove(h, best);
+  return best;
+}
+
+
+void free_heap(task_heap* h) {
+  free(h->tasks);
+  h->tasks = NULL;
+  h->size = 0;
+  h->cap = 0;
+}
+
+
+// Task table
+
+void task_table_init(task_table* table) {
+  table->chunks = NULL;
+  table->num_chunks = 0;
+  table->allocated = 0;
+  table->count = 0;
+  table->num_live = 0;
+  table->live_head = NULL;
+  table->free_tasks = NULL;
+  table->num_buckets = INITIAL_BUCKETS;
+  table->buckets = calloc(table->num_buckets, sizeof(task*));
+
+  if (table->buckets == NULL) {
+    fprintf(stderr, "task table allocation failed\n");
+    exit(-1);
+  }
+}
+
+
+task* task_table_add(task_table* table, pid_t pid) {
+  // allocate a new chunk when no removed task is free and the last chunk is full
+  if (table->free_tasks == NULL && table->allocated == table->num_chunks * TASK_CHUNK_SIZE) {
+    task** chunks = realloc(table->chunks, sizeof(task*) * (table->num_chunks + 1));
+    task* chunk = calloc(TASK_CHUNK_SIZE, sizeof(task));
+    if (chunks == NULL || chunk == NULL) {
+      fprintf(stderr, "task table allocation failed\n");
+      exit(-1);
+    }
+    chunks[table->num_chunks++] = chunk;
+    table->chunks = chunks;
+  }
+
+  // keep the average chain length under two
+  if (table->num_live + 1 > table->num_buckets * 2) {
+    grow_buckets(table);
+  }
+
+  // a reused task starts over from zero like a fresh one from calloc
+  task* t;
+  if (table->free_tasks != NULL) {
+    t = table->free_tasks;
+    table->free_tasks = t->live_next;
+    memset(t, 0, sizeof(*t));
+  }
+  else {
+    t = &table->chunks[table->allocated / TASK_CHUNK_SIZE][table->allocated % TASK_CHUNK_SIZE];
+    ++table->allocated;
+  }
+  t->pid = pid;
+  t->index = table->count++;
+  t->state = TASK_READY;
+  t->slot = -1;
+  t->last_slot = -1;
+  t->last_cpu = -1;
+  t->weight = 1;
+  t->heap_index = -1;
+  t->pidfd = -1;
+
+  // append to the live list
+  if (table->live_head == NULL) {
+    t->live_next = t;
+    t->live_prev = t;
+    table->live_head = t;
+  }
+  else {
+    task* tail = table->live_head->live_prev;
+    t->live_next = table->live_head;
+    t->live_prev = tail;
+    tail->live_next = t;
+    table->live_head->live_prev = t;
+  }
+  ++table->num_live;
+
+  int bucket = pid_bucket(pid, table->num_buckets);
+  t->hash_next = table->buckets[bucket];
+  table->buckets[bucket] = t;
+
+  return t;
+}
+
+
+task* task_table_find(task_table* table, pid_t pid) {
+  task* t = table->buckets[pid_bucket(pid, table->num_buckets)];
+  while (t != NULL && t->pid != pid) {
+    t = t->hash_next;
+  }
+  return t;
+}
+
+
+task* task_table_find_index(task_table* table, int index) {
+  task* t = table->live_head;
+  for (int i = 0; i < table->num_live; ++i, t = t->live_next) {
+    if (t->index == index) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+
+void task_table_remove(task_table* table, task* t) {
+  // unlink from the pid chain
+  task** link = &table->buckets[pid_bucket(t->pid, table->num_buckets)];
+  while (*link != t) {
+    link = &(*link)->hash_next;
+  }
+  *link = t->hash_next;
+  t->hash_next = NULL;
+
+  // unlink from the live list
+  if (t->live_next == t) {
+    table->live_head = NULL;
+  }
+  else {
+    t->live_prev->live_next = t->live_next;
+    t->live_next->live_prev = t->live_prev;
+    if (table->live_head == t) {
+      table->live_head = t->live_next;
+    }
+  }
+  --table->num_live;
+
+  // free for the next add, the caller must not touch it again
+  t->state = TASK_EXITED;
+  t->live_prev = NULL;
+  t->live_next = table->free_tasks;
+  table->free_tasks = t;
+}
+
+
+void free_task_table(task_table* table) {
+  for (int i = 0; i < table->num_chunks; ++i) {
+    free(table->chunks[i]);
+  }
+  free(table->chunks);
+  free(table->buckets);
+  table->chunks = NULL;
+  table->buckets = NULL;
+  table->num_chunks = 0;
+  table->allocated = 0;
+  table->free_tasks = NULL;
+  table->count = 0;
+  table->num_live = 0;
+  table->live_head = NULL;
+}
+
+
+static int pid_bucket(pid_t pid, int num_buckets) {
+  // multiplicative hash, sequential pids spread across buckets
+  return (int)(((unsigned int)pid * 2654435761u) & (unsigned int)(num_buckets - 1));
+}
+
+
+static void grow_buckets(task_table* table) {
+  int num_buckets = table->num_buckets * 2;
+  task** buckets = calloc(num_buckets, sizeof(task*));
+  if (buckets == NULL) {
+    // lookups still work with longer chains
+    return;
+  }
+
+  // every hashed task is on the live list
+  task* t = table->live_head;
+  for (int i = 0; i < table->num_live; ++i) {
+    int bucket = pid_bucket(t->pid, num_buckets);
+    t->hash_next = buckets[bucket];
+    buckets[bucket] = t;
+    t = t->live_next;
+  }
+
+  free(table->buckets);
+  table->buckets = buckets;
+  table->num_buckets = num_buckets;
+}
+
+
+
+static void sift_up(task_heap* h, int i) {
+  task* t = h->tasks[i];
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!h->before(t, h->tasks[parent])) {
+      break;
+    }
+    heap_place(h, i, h->tasks[parent]);
+    i = parent;
+  }
+  heap_place(h, i, t);
+}
+
+
+static void sift_down(task_heap* h, int i) {
+  task* t = h->tasks[i];
+  while (1) {
+    int child = 2 * i + 1;
+    if (child >= h->size) {
+      break;
+    }
+    if (child + 1 < h->size && h->before(h->tasks[child + 1], h->tasks[child])) {
+      ++child;
+    }
+    if (!h->before(h->tasks[child], t)) {
+      break;
+    }
+    heap_place(h, i, h->tasks[child]);
+    i = child;
+  }
+  heap_place(h, i, t);
+}
+
+
+static void heap_place(task_heap* h, int i, task* t) {
+  h->tasks[i] = t;
+  t->heap_index = i;
+}
+
+// Scheduling policies
+
+int scheduler_init(scheduler* s, const char* policy, long quantum_us) {
+  memset(s, 0, sizeof(*s));
+  s->quantum_us = quantum_us;
+
+  if (strcmp(policy, "rr") == 0) {
+    rr_init(s);
+  }
+  else if (strcmp(policy, "mlfq") == 0) {
+    mlfq_init(s);
+  }
+  else if (strcmp(policy, "stride") == 0) {
+    stride_init(s);
+  }
+  else if (strcmp(policy, "cfs") == 0) {
+    cfs_init(s);
+  }
+  else {
+    return -1;
+  }
+  return 0;
+}
+
+
+void free_scheduler(scheduler* s) {
+  if (s->release != NULL) {
+    s->release(s);
+  }
+  free(s->data);
+  s->data = NULL;
+}
+
+
+int task_allowed(task* t, int cpu) {
+  // CPUs past the end of the mask can't be named by the workload
+  if (cpu < 0 || t->cpus == 0) {
+    return 1;
+  }
+  return cpu < 64 && (t->cpus >> cpu) & 1;
+}
+
+
+// Utilities
+
+long long now_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
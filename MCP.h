@@ -0,0 +1,526 @@
+// ./MCP.h
+
+#ifndef MCP_H
+#define MCP_H
+
+#include<sys/types.h>
+#include<stdint.h>
+#include<time.h>
+
+
+// Types
+
+// One reading of /proc/<pid>/stat and /proc/<pid>/io
+typedef struct proc_sample {
+  char name[64];            // comm, without the parentheses
+  char state;               // R, S, D, T, Z, ...
+  unsigned long utime_ticks;
+  unsigned long stime_ticks;
+  double utime;             // user time in seconds
+  double stime;             // kernel time in seconds
+  unsigned long rchar;      // bytes read
+  unsigned long wchar;      // bytes written
+  unsigned long voluntary_switches;     // from status, see sample_proc_status
+  unsigned long involuntary_switches;
+  unsigned long long cpu_delay_ns;      // waiting for a CPU, netlink only
+  unsigned long long blkio_delay_ns;    // waiting for block I/O, netlink only
+} proc_sample;
+
+// /proc files of a child, opened once and re-read with pread on every
+// sample. -1 for files that could not be opened
+typedef struct proc_files {
+  int stat_fd;
+  int io_fd;
+  int status_fd;
+} proc_files;
+
+// cgroup v2 directory of one job and the files the MCP keeps open in it.
+// -1 for files that could not be opened, dir_fd is -1 without a cgroup
+typedef struct job_cgroup {
+  int dir_fd;
+  int freeze_fd;            // cgroup.freeze
+  int cpu_stat_fd;          // cpu.stat
+  int io_stat_fd;           // io.stat, only with the io controller
+} job_cgroup;
+
+// Lifecycle of a workload process
+typedef enum task_state {
+  TASK_READY,     // stopped, waiting in a run queue
+  TASK_RUNNING,   // holds the CPU for the current quantum
+  TASK_SUSPENDED, // stopped by a control request, in no run queue
+  TASK_BLOCKED,   // left its slot asleep on I/O, not stopped, see --io-probe
+  TASK_EXITED     // reaped, kept only for its index
+} task_state;
+
+// A workload process managed by the MCP. The list links are intrusive so
+// the run queue and live list never allocate
+typedef struct task {
+  pid_t pid;                // pid of the child process
+  int pidfd;                // signals and exit notification, -1 if the kernel has none
+  int index;                // line number in the input file
+  task_state state;
+
+  struct task* rq_next;     // run queue links, NULL when not queued. A
+                            // TASK_BLOCKED task is linked into the parked list
+  struct task* rq_prev;
+
+  struct task* live_next;   // live list links, every task not yet reaped
+  struct task* live_prev;
+
+  struct task* hash_next;   // pid lookup chain
+
+  int level;                // scheduler queue level, 0 is the highest priority
+  unsigned long epoch;      // scheduler generation 'level' was assigned in
+  long long dispatched_us;  // when the task last got the CPU
+  long long launched_us;    // when the process was started
+  long long first_run_us;   // when it first got the CPU, 0 until then
+  long long wait_us;        // time spent ready but not running, up to the last dispatch
+  int dispatches;           // times it was given a slot
+  long long exited_us;      // when it was reaped, 0 until then
+  long long stopped_us;     // when the task was last preempted
+  int slot;                 // execution slot running the task, -1 if none
+  int last_slot;            // slot the task last ran on, -1 if never
+  int last_cpu;             // CPU the task was last pinned to, -1 if never
+  int queue;                // slot whose run queue the task belongs to
+  double cpu_time;          // utime + stime at the last sample, in seconds
+  unsigned long io_bytes;   // rchar + wchar at the last sample
+  proc_files proc;          // open /proc files, closed when reaped
+  job_cgroup cgroup;        // --control cgroup only, removed when reaped
+  int priority;             // from the workload, 0 if it gives none
+  int weight;               // CPU share relative to other tasks, at least 1
+  long quantum_us;          // base quantum from the workload, 0 for the scheduler's
+  long long burst_us;       // --adaptive: smoothed CPU burst, 0 until measured
+  int boosted;              // woke from I/O, goes ahead of its queue when next enqueued
+  double probe_cpu;         // --io-probe: CPU time at the last probe, job-wide under cgroups
+  unsigned long long cpus;  // CPUs the task may run on, 0 for any
+  unsigned long long pass;  // virtual time of stride and cfs, their own units
+  int heap_index;           // position in a task_heap, -1 when not in one
+  unsigned long long enqueue_seq;       // cfs: order it was queued in, breaks vruntime ties
+  long long exec_us;        // when the workload was exec'd, netlink only
+  int forks;                // processes the workload forked, netlink only
+  unsigned long long cpu_delay_ns;      // waiting for a CPU over its life, netlink exit record only
+  unsigned long long blkio_delay_ns;    // waiting for block I/O over its life, netlink exit record only
+} task;
+
+// What --metrics keeps of a job once its task is retired and reused
+typedef struct task_record {
+  long long launched_us;
+  long long first_run_us;   // 0 if it never ran
+  long long exited_us;
+  double cpu_time;
+  unsigned long io_bytes;
+  unsigned long long cpu_delay_ns;
+  unsigned long long blkio_delay_ns;
+} task_record;
+
+// Kernel sockets used for --accounting netlink
+typedef struct netlink_acct {
+  int query_fd;             // TASKSTATS queries
+  int exit_fd;              // final taskstats the kernel sends at every exit
+  int connector_fd;         // proc connector fork/exec events, -1 if unavailable
+  int family_id;            // TASKSTATS generic netlink family
+  unsigned int seq;
+} netlink_acct;
+
+// The MCP's cgroup v2 subtree for --control cgroup, holding one cgroup per job
+typedef struct cgroup_ctl {
+  char path[512];           // mcp-<pid> under the cgroup the MCP was started in
+  int dir_fd;
+  int has_cpu;              // cpu controller enabled, cpu.weight and cpu.max work
+  int has_io;               // io controller enabled, io.stat counts block I/O
+} cgroup_ctl;
+
+// Something that happened to a process, read from a netlink socket
+typedef enum acct_event_type {
+  ACCT_FORK,
+  ACCT_EXEC,
+  ACCT_EXIT
+} acct_event_type;
+
+typedef struct acct_event {
+  acct_event_type type;
+  pid_t pid;                // process the event is about
+  pid_t parent;             // ACCT_FORK and ACCT_EXIT: its parent
+  int exit_code;            // ACCT_EXIT only
+  proc_sample totals;       // ACCT_EXIT only: lifetime CPU, I/O and delays
+} acct_event;
+
+// Kinds of trace_event
+typedef enum trace_type {
+  TRACE_SPAWN,              // value: line number of the job
+  TRACE_DISPATCH,           // the task got 'slot'
+  TRACE_PREEMPT,            // the task was stopped and requeued
+  TRACE_BLOCK,              // sampled asleep at the end of its slice, value: the state letter
+  TRACE_EXIT,               // value: wait status
+  TRACE_SAMPLE,             // value: CPU time so far in microseconds
+  TRACE_PARK,               // left its slot asleep, value: the state letter
+  TRACE_WAKE                // a parked task became runnable and was requeued
+} trace_type;
+
+// One scheduling event as written to the trace file, fixed size so the
+// file can be read back as an array
+typedef struct trace_event {
+  int64_t time_us;          // CLOCK_MONOTONIC
+  int64_t value;            // depends on the type
+  int32_t pid;
+  int16_t type;             // trace_type
+  int16_t slot;             // slot it happened on, -1 if none
+} trace_event;
+
+// Version of the trace file layout below
+#define TRACE_VERSION 1
+
+// Start of a trace file, followed by its trace_events
+typedef struct trace_header {
+  char magic[4];            // "MCPT"
+  uint32_t version;
+  uint32_t event_size;      // sizeof(trace_event)
+  uint32_t reserved;
+  uint64_t dropped;         // events lost to a full ring or a failed write, filled in at close
+} trace_header;
+
+// Most clients the control socket serves at once
+#define CONTROL_MAX_CLIENTS 16
+
+// A connection to the control socket, one request and its reply
+typedef struct control_client {
+  int fd;                   // -1 for a free entry
+  char request[256];        // the request line as read so far
+  size_t request_len;
+  char* reply;              // NULL until the request is complete
+  size_t reply_len;
+  size_t sent;              // bytes of the reply already written
+} control_client;
+
+// Unix socket the running MCP answers requests on, see control.c
+typedef struct control_server {
+  int listen_fd;            // -1 when not listening
+  char path[108];
+  control_client clients[CONTROL_MAX_CLIENTS];
+} control_server;
+
+// Workload lines read as they arrive. 'buffer' holds [start, end) of
+// unread input, the last line handed out stays valid until the next read
+typedef struct line_reader {
+  int fd;
+  char* buffer;
+  size_t cap;
+  size_t start;             // first unread byte
+  size_t end;               // one past the last byte read
+  size_t scanned;           // bytes before this hold no newline
+  int at_eof;               // read() returned 0
+  int done;                 // at_eof and every line handed out
+} line_reader;
+
+// Circular doubly linked list of tasks, 'head' is the next task to run
+typedef struct run_queue {
+  task* head;
+  int size;
+} run_queue;
+
+// Binary min-heap of tasks ordered by 'before'. Each task knows its
+// position, so any task can be removed in O(log n)
+typedef struct task_heap {
+  task** tasks;
+  int size;
+  int cap;
+  int (*before)(task* a, task* b);   // 1 if 'a' should come out ahead of 'b'
+} task_heap;
+
+// Owns every live task. Tasks are allocated in fixed-size chunks so
+// pointers stay valid as the table grows, and are found by pid through a
+// hash. A removed task is reused by a later add, so the chunks only grow
+// with the most tasks ever live at once, not with every job launched
+typedef struct task_table {
+  task** chunks;
+  int num_chunks;
+  int allocated;            // tasks handed out from the chunks so far
+  int count;                // tasks ever added, the next task's index
+  int num_live;             // tasks not yet reaped
+
+  task* live_head;          // circular list of live tasks
+  task* free_tasks;         // removed tasks to reuse, linked through live_next
+
+  task** buckets;           // pid -> task chains
+  int num_buckets;
+} task_table;
+
+// A scheduling policy. The MCP only talks to the ready tasks through these
+// hooks, the running task is never queued
+typedef struct scheduler {
+  const char* name;
+  long quantum_us;          // base length of a time slice
+  int nr_ready;             // number of queued tasks
+  void* data;               // policy private state
+
+  // Queues 't', which just became ready
+  void (*enqueue)(struct scheduler* s, task* t);
+
+  // Removes and returns the task that runs next on 'cpu', NULL if none
+  // that may run there are ready. 'cpu' is -1 for an unpinned slot
+  task* (*pick_next)(struct scheduler* s, int cpu);
+
+  // Removes a queued 't' that terminated
+  void (*dequeue)(struct scheduler* s, task* t);
+
+  // Charges the running 't' for its slice: 'cpu_used' seconds of CPU and
+  // 'io_bytes' bytes read or written over 'ran_us' microseconds
+  void (*account)(struct scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us);
+
+  // Returns the length of the next time slice for 't'
+  long (*task_quantum)(struct scheduler* s, task* t);
+
+  // Removes and returns a queued task that has been off the CPU for at
+  // least 'min_idle_us' and may run on 'cpu', to migrate it to another
+  // slot. NULL if there is none
+  task* (*steal)(struct scheduler* s, long long min_idle_us, int cpu);
+
+  // Frees private state beyond 'data' itself, NULL if there is none
+  void (*release)(struct scheduler* s);
+} scheduler;
+
+// One CPU the MCP keeps a workload running on
+typedef struct cpu_slot {
+  int cpu;                  // CPU tasks on this slot are pinned to, -1 if unpinned
+  task* current;            // task holding the slot, NULL if idle
+  scheduler* sched;         // run queue of the slot, possibly shared
+  int timer_fd;             // quantum timer
+  struct timespec deadline; // when the current quantum is meant to end
+  int probing;              // the timer is set for an --io-probe before the deadline
+} cpu_slot;
+
+// Sizes quanta for --adaptive from the measured cost of a context switch
+// and each task's CPU bursts, see quantum_tuner.c
+typedef struct quantum_tuner {
+  double target_pct;        // share of the CPU context switches may cost
+  long min_us;              // bounds on every quantum handed out
+  long max_us;
+  double switch_us;         // smoothed latency from stopping a task to resuming the next
+  double mcp_cpu_us;        // smoothed MCP CPU time per switch
+  long floor_us;            // shortest quantum within target_pct
+  unsigned long switches;   // switches measured
+  unsigned long slices;     // quanta handed out
+  long long total_quantum_us;
+  long long begin_cpu_us;   // MCP CPU time when the switch being measured began
+} quantum_tuner;
+
+
+// Run queue
+
+// Initializes an empty run queue
+void rq_init(run_queue* rq);
+
+// Appends 't' to the tail of 'rq', O(1)
+void rq_push(run_queue* rq, task* t);
+
+// Puts 't' at the head of 'rq', next in line, O(1)
+void rq_push_front(run_queue* rq, task* t);
+
+// Removes and returns the head of 'rq', NULL if empty, O(1)
+task* rq_pop(run_queue* rq);
+
+// Unlinks 't' from anywhere in 'rq', O(1)
+void rq_remove(run_queue* rq, task* t);
+
+// Returns 1 if 't' is queued in a run queue or a task heap
+int rq_queued(task* t);
+
+// Moves every task in 'src' to the tail of 'dst', O(1)
+void rq_splice(run_queue* dst, run_queue* src);
+
+// Returns the task closest to the head of 'rq' that may run on 'cpu', NULL if none may
+task* rq_first_allowed(run_queue* rq, int cpu);
+
+
+// Task heap
+
+// Initializes an empty heap ordered by 'before'
+void heap_init(task_heap* h, int (*before)(task* a, task* b));
+
+// Adds 't', O(log n)
+void heap_push(task_heap* h, task* t);
+
+// Removes 't' from anywhere in the heap, O(log n)
+void heap_remove(task_heap* h, task* t);
+
+// Removes and returns the first task that may run on 'cpu', NULL if none may.
+// O(log n) unless the first task is pinned elsewhere
+task* heap_pop_allowed(task_heap* h, int cpu);
+
+// Frees the heap's array
+void free_heap(task_heap* h);
+
+
+// Task table
+
+// Initializes an empty task table
+void task_table_init(task_table* table);
+
+// Adds a task for 'pid', returns the new task
+task* task_table_add(task_table* table, pid_t pid);
+
+// Returns the task for 'pid', NULL if there is none, O(1) on average
+task* task_table_find(task_table* table, pid_t pid);
+
+// Returns the live task added 'index'-th, NULL if it has been removed, O(live)
+task* task_table_find_index(task_table* table, int index);
+
+// Drops 't' from the live list and pid lookup and frees it for reuse by a later add
+void task_table_remove(task_table* table, task* t);
+
+// Frees every task in 'table'
+void free_task_table(task_table* table);
+
+
+// Scheduling policies
+
+// Sets up 's' with the policy named 'policy', returns -1 if there is no such policy
+int scheduler_init(scheduler* s, const char* policy, long quantum_us);
+
+// Frees the private state of 's'
+void free_scheduler(scheduler* s);
+
+// Round-robin with a fixed quantum
+void rr_init(scheduler* s);
+
+// Multi-level feedback queue, see sched_mlfq.c
+void mlfq_init(scheduler* s);
+
+// Stride scheduling by weight within strict priority classes, see sched_stride.c
+void stride_init(scheduler* s);
+
+// Completely fair scheduling by measured CPU time, see sched_cfs.c
+void cfs_init(scheduler* s);
+
+// Returns 1 if 't' may run on 'cpu', any task may run on an unpinned slot (-1)
+int task_allowed(task* t, int cpu);
+
+
+// Process sampling
+
+// Opens the stat, io and status files of 'pid', returns -1 if stat could not be opened
+int open_proc_files(pid_t pid, proc_files* files);
+
+// Closes every file opened by open_proc_files
+void close_proc_files(proc_files* files);
+
+// Reads the stat and io counters into 'out', returns -1 if the process is gone
+int sample_proc(proc_files* files, proc_sample* out);
+
+// Reads the context switch counts from status into 'out', returns -1 if the process is gone
+int sample_proc_status(proc_files* files, proc_sample* out);
+
+// Reads only the stat counters and state into 'out', returns -1 if the process is gone
+int sample_proc_stat(proc_files* files, proc_sample* out);
+
+
+// Netlink accounting
+
+// Opens the taskstats and proc connector sockets, returns -1 if netlink is not permitted
+int netlink_acct_open(netlink_acct* acct);
+
+// Closes every socket opened by netlink_acct_open
+void netlink_acct_close(netlink_acct* acct);
+
+// Queries the taskstats of 'pid' into 'out', returns -1 if the process is gone
+int netlink_sample(netlink_acct* acct, pid_t pid, proc_sample* out);
+
+// Calls 'handle' for every event pending on 'fd', the exit or connector socket of 'acct'
+int netlink_drain(netlink_acct* acct, int fd, void (*handle)(acct_event* ev, void* ctx), void* ctx);
+
+
+// Cgroup job control
+
+// Creates the MCP's subtree under its own cgroup, returns -1 without a writable cgroup v2 hierarchy
+int cgroup_ctl_open(cgroup_ctl* cg);
+
+// Removes the subtree and any job cgroups left in it
+void cgroup_ctl_close(cgroup_ctl* cg);
+
+// Creates the cgroup of the job launched 'index'-th, returns -1 if it can't be made
+int cgroup_create_job(cgroup_ctl* cg, int index, job_cgroup* job);
+
+// Kills whatever is left in the job's cgroup and removes it
+void cgroup_remove_job(cgroup_ctl* cg, int index, job_cgroup* job);
+
+// Moves 'pid' into the job's cgroup, 0 moves the caller
+int cgroup_attach(job_cgroup* job, pid_t pid);
+
+// Freezes (1) or thaws (0) every process in the job, returns -1 on failure
+int cgroup_freeze(job_cgroup* job, int frozen);
+
+// Sends SIGKILL to every process in the job
+int cgroup_kill(job_cgroup* job);
+
+// Sets cpu.weight from 'weight' and cpu.max to 'max_percent' of a CPU, 0 for no cap
+int cgroup_set_cpu(job_cgroup* job, int weight, int max_percent);
+
+// Overwrites the CPU and I/O counters in 'out' with the whole job's, returns -1 if they can't be read
+int cgroup_sample(job_cgroup* job, proc_sample* out);
+
+
+// Adaptive quantum
+
+// Starts tuning for an overhead of 'target_pct' percent with quanta in [min_us, max_us]
+void tuner_init(quantum_tuner* q, double target_pct, long min_us, long max_us);
+
+// Marks the start of a context switch at the end of a slice
+void tuner_begin_switch(quantum_tuner* q);
+
+// Measures the switch begun last, the previous task was stopped at 'stopped_us'
+void tuner_end_switch(quantum_tuner* q, long long stopped_us);
+
+// Updates the burst estimate of 't', which used 'cpu_used' seconds of CPU over 'ran_us'
+void tuner_record_slice(quantum_tuner* q, task* t, double cpu_used, long ran_us);
+
+// Returns the next quantum of 't' on a slot scheduled by 's'
+long tuner_quantum(quantum_tuner* q, scheduler* s, task* t);
+
+
+// Tracing
+
+// Starts tracing to 'path' with a background flusher, returns -1 if the file or thread can't be made
+int trace_open(const char* path);
+
+// Records an event, a no-op unless tracing. Never blocks, drops the event if the ring is full
+void trace_emit(trace_type type, pid_t pid, int slot, long long value);
+
+// Flushes and closes the trace, returns how many events were dropped
+unsigned long long trace_close();
+
+
+// Control socket
+
+// Listens on a Unix socket at 'path' and watches it with 'epoll_fd', returns -1 if it can't be bound
+int control_open(control_server* srv, const char* path, int epoll_fd);
+
+// Closes every connection and the socket, and removes its path
+void control_close(control_server* srv, int epoll_fd);
+
+// Returns 1 if 'fd' is the socket or one of its connections
+int control_owns(control_server* srv, int fd);
+
+// Handles 'events' on 'fd'. A complete request line is answered with what 'serve' returns,
+// a malloc'd reply of '*len' bytes the server frees once sent, NULL to hang up
+void control_handle(control_server* srv, int epoll_fd, int fd, uint32_t events,
+  char* (*serve)(const char* request, size_t* len, void* ctx), void* ctx);
+
+
+// Workload input
+
+// Opens 'path' for streaming, "-" is stdin, returns -1 if it can't be opened
+int line_reader_open(line_reader* r, const char* path);
+
+// Closes the input and frees the buffers
+void line_reader_close(line_reader* r);
+
+// Sets 'line' to the next complete line, returns 1, 0 if none has arrived yet or -1 at the end of the input
+int line_reader_next(line_reader* r, char** line);
+
+
+// Utilities
+
+// Returns CLOCK_MONOTONIC time in microseconds
+long long now_us();
+
+#endif
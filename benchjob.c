@@ -0,0 +1,97 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <time.h>
+
+/*
+ * Synthetic job for the scheduler benchmark. Each of -repeat rounds spins
+ * for -cpu ms of CPU time, sleeps for -sleep ms, then writes and syncs
+ * -io 4 KiB blocks to a scratch file, so one program covers CPU-bound,
+ * I/O-bound, bursty (short CPU, long sleep, many rounds), short-lived and
+ * phase-changing (CPU then I/O) jobs. CPU and I/O are both fixed amounts
+ * of work, never wall time, so a job does the same under every schedule
+ * however long it is kept stopped.
+ */
+
+/* Spins until the process has used 'ms' more milliseconds of CPU */
+static void burn_cpu(long ms) {
+    clock_t start = clock();
+    volatile unsigned long i = 0;
+    while ((clock() - start) * 1000.0 / CLOCKS_PER_SEC < ms) {
+        i = i + (i * 2) + 1;
+    }
+}
+
+/* Sleeps for 'ms' milliseconds of wall time */
+static void sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) == -1) {
+    }
+}
+
+/* Writes and syncs 'blocks' 4 KiB blocks to 'fd' */
+static void do_io(int fd, long blocks) {
+    char block[4096];
+    long n;
+    memset(block, 'A', sizeof(block));
+    for (n = 0; n < blocks; n++) {
+        if (write(fd, block, sizeof(block)) == -1 || fdatasync(fd) == -1) {
+            return;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int i, round, repeat = 1;
+    long cpu_ms = 0, sleep_time_ms = 0, io_blocks = 0;
+    int fd = -1;
+
+/*
+ * process command line arguments, every flag takes a value
+ */
+    for (i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for `%s'\n", argv[i]);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-cpu") == 0) {
+            cpu_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-sleep") == 0) {
+            sleep_time_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-io") == 0) {
+            io_blocks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-repeat") == 0) {
+            repeat = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Illegal flag: `%s'\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (io_blocks > 0) {
+        char path[] = "/tmp/benchjob.XXXXXX";
+        fd = mkstemp(path);
+        if (fd == -1) {
+            perror("mkstemp");
+            exit(1);
+        }
+        unlink(path);
+    }
+
+    for (round = 0; round < repeat; round++) {
+        burn_cpu(cpu_ms);
+        if (sleep_time_ms > 0) {
+            sleep_ms(sleep_time_ms);
+        }
+        if (io_blocks > 0) {
+            do_io(fd, io_blocks);
+        }
+    }
+
+    if (fd != -1) {
+        close(fd);
+    }
+    return 0;
+}
@@ -0,0 +1,338 @@
+// ./cgroup_ctl.c
+
+// Job control through cgroup v2 instead of signals. The MCP makes a
+// mcp-<pid> cgroup under its own and every job gets a job-<index> cgroup
+// inside it, joined before exec so anything the job forks lands there too.
+//  - cgroup.freeze stops and resumes the whole job, grandchildren included
+//  - cgroup.kill takes the job down with every stray it left behind
+//  - cpu.stat and io.stat count the CPU and I/O of the whole job
+//  - cpu.weight and cpu.max share and cap CPU when the cpu controller is
+//    delegated, io.stat needs the io controller
+// Freezing is asynchronous, the write returns before every task has
+// stopped, just like a SIGSTOP. cgroup_ctl_open fails without a writable
+// cgroup v2 hierarchy and the MCP falls back to signals
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<dirent.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Large enough for cpu.stat and io.stat with a few devices
+#define CG_BUFFER_SIZE 4096
+
+// Period cpu.max quotas are given over, in microseconds
+#define CG_CPU_PERIOD_US 100000
+
+
+// Signatures
+
+// Finds the cgroup v2 directory the MCP runs in, returns -1 if there is none
+static int own_cgroup_path(char* path, size_t size);
+
+// Writes 'value' to 'file' in the directory 'dir_fd', returns -1 on failure
+static int write_cgroup_file(int dir_fd, const char* file, const char* value);
+
+// Opens 'file' in the directory 'dir_fd' for reading, -1 if it isn't there
+static int open_cgroup_file(int dir_fd, const char* file);
+
+// Re-reads the whole of an open cgroup file into 'buffer', returns its length or -1
+static ssize_t read_cgroup_file(int fd, char* buffer);
+
+// Returns the value of 'key' in a "key value" file such as cpu.stat, 0 if missing
+static unsigned long long stat_value(const char* buffer, const char* key);
+
+// Adds up every "key=value" field named 'key' in io.stat, one line per device
+static unsigned long long io_stat_total(const char* buffer, const char* key);
+
+
+// Globals
+
+// Shared by every sample, the MCP is single threaded
+static char cg_buffer[CG_BUFFER_SIZE];
+
+
+int cgroup_ctl_open(cgroup_ctl* cg) {
+  char parent[sizeof(cg->path)];
+  cg->dir_fd = -1;
+  cg->has_cpu = 0;
+  cg->has_io = 0;
+
+  if (own_cgroup_path(parent, sizeof(parent)) == -1) {
+    return -1;
+  }
+  snprintf(cg->path, sizeof(cg->path), "%s/mcp-%d", parent, getpid());
+  if (mkdir(cg->path, 0755) == -1 && errno != EEXIST) {
+    return -1;
+  }
+  cg->dir_fd = open(cg->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cg->dir_fd == -1) {
+    rmdir(cg->path);
+    return -1;
+  }
+
+  // the freezer is the one thing every job needs, it came with 5.2
+  if (faccessat(cg->dir_fd, "cgroup.freeze", W_OK, 0) == -1) {
+    cgroup_ctl_close(cg);
+    return -1;
+  }
+
+  // Controllers have to be enabled on the way down. The parent refuses if
+  // it holds processes of its own, the MCP among them, unless it's the
+  // root; jobs can still be frozen and counted, just not weighted
+  int parent_fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (parent_fd != -1) {
+    write_cgroup_file(parent_fd, "cgroup.subtree_control", "+cpu");
+    write_cgroup_file(parent_fd, "cgroup.subtree_control", "+io");
+    close(parent_fd);
+  }
+  cg->has_cpu = write_cgroup_file(cg->dir_fd, "cgroup.subtree_control", "+cpu") == 0;
+  cg->has_io = write_cgroup_file(cg->dir_fd, "cgroup.subtree_control", "+io") == 0;
+  return 0;
+}
+
+
+void cgroup_ctl_close(cgroup_ctl* cg) {
+  if (cg->dir_fd == -1) {
+    return;
+  }
+
+  // jobs whose strays were still dying when they were reaped
+  DIR* dir = fdopendir(dup(cg->dir_fd));
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      if (strncmp(entry->d_name, "job-", 4) == 0) {
+        unlinkat(cg->dir_fd, entry->d_name, AT_REMOVEDIR);
+      }
+    }
+    closedir(dir);
+  }
+
+  close(cg->dir_fd);
+  cg->dir_fd = -1;
+  rmdir(cg->path);
+}
+
+
+int cgroup_create_job(cgroup_ctl* cg, int index, job_cgroup* job) {
+  char name[32];
+  snprintf(name, sizeof(name), "job-%d", index);
+  job->dir_fd = -1;
+  job->freeze_fd = -1;
+  job->cpu_stat_fd = -1;
+  job->io_stat_fd = -1;
+
+  if (mkdirat(cg->dir_fd, name, 0755) == -1 && errno != EEXIST) {
+    return -1;
+  }
+  job->dir_fd = openat(cg->dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (job->dir_fd == -1) {
+    unlinkat(cg->dir_fd, name, AT_REMOVEDIR);
+    return -1;
+  }
+
+  // switching a job is one write, keep the fd rather than reopening it
+  job->freeze_fd = openat(job->dir_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC);
+  job->cpu_stat_fd = open_cgroup_file(job->dir_fd, "cpu.stat");
+  job->io_stat_fd = cg->has_io ? open_cgroup_file(job->dir_fd, "io.stat") : -1;
+  if (job->freeze_fd == -1) {
+    cgroup_remove_job(cg, index, job);
+    return -1;
+  }
+  return 0;
+}
+
+
+void cgroup_remove_job(cgroup_ctl* cg, int index, job_cgroup* job) {
+  if (job->dir_fd == -1) {
+    return;
+  }
+
+  // a job ends with its main process, strays would otherwise run on
+  // outside the MCP's control
+  write_cgroup_file(job->dir_fd, "cgroup.kill", "1");
+
+  int* fds[] = {&job->dir_fd, &job->freeze_fd, &job->cpu_stat_fd, &job->io_stat_fd};
+  for (int i = 0; i < 4; ++i) {
+    if (*fds[i] != -1) {
+      close(*fds[i]);
+      *fds[i] = -1;
+    }
+  }
+
+  // busy until the killed strays are gone, cgroup_ctl_close retries
+  char name[32];
+  snprintf(name, sizeof(name), "job-%d", index);
+  unlinkat(cg->dir_fd, name, AT_REMOVEDIR);
+}
+
+
+int cgroup_attach(job_cgroup* job, pid_t pid) {
+  char value[16];
+  snprintf(value, sizeof(value), "%d", pid);
+  return write_cgroup_file(job->dir_fd, "cgroup.procs", value);
+}
+
+
+int cgroup_freeze(job_cgroup* job, int frozen) {
+  return pwrite(job->freeze_fd, frozen ? "1" : "0", 1, 0) == 1 ? 0 : -1;
+}
+
+
+int cgroup_kill(job_cgroup* job) {
+  return write_cgroup_file(job->dir_fd, "cgroup.kill", "1");
+}
+
+
+int cgroup_set_cpu(job_cgroup* job, int weight, int max_percent) {
+  char value[32];
+  int status = 0;
+
+  // cpu.weight is 1 to 10000 with 100 as the default, so weight 1 is 100.
+  // Always written, a weight lowered back to 1 must reach the kernel too
+  long long cpu_weight = (long long)weight * 100;
+  if (cpu_weight < 1) {
+    cpu_weight = 100;
+  }
+  if (cpu_weight > 10000) {
+    cpu_weight = 10000;
+  }
+  snprintf(value, sizeof(value), "%lld", cpu_weight);
+  status |= write_cgroup_file(job->dir_fd, "cpu.weight", value);
+  if (max_percent > 0) {
+    snprintf(value, sizeof(value), "%d %d", max_percent * CG_CPU_PERIOD_US / 100, CG_CPU_PERIOD_US);
+    status |= write_cgroup_file(job->dir_fd, "cpu.max", value);
+  }
+  return status;
+}
+
+
+int cgroup_sample(job_cgroup* job, proc_sample* out) {
+  if (read_cgroup_file(job->cpu_stat_fd, cg_buffer) == -1) {
+    return -1;
+  }
+  out->utime = stat_value(cg_buffer, "user_usec") / 1e6;
+  out->stime = stat_value(cg_buffer, "system_usec") / 1e6;
+
+  // block I/O rather than rchar/wchar, which also count pipes and page cache
+  if (read_cgroup_file(job->io_stat_fd, cg_buffer) != -1) {
+    out->rchar = io_stat_total(cg_buffer, "rbytes");
+    out->wchar = io_stat_total(cg_buffer, "wbytes");
+  }
+  return 0;
+}
+
+
+static int own_cgroup_path(char* path, size_t size) {
+  char* line = NULL;
+  size_t cap = 0;
+  char mount[256] = "";
+  char own[256] = "";
+
+  // the unified hierarchy is mounted as cgroup2, at /sys/fs/cgroup or
+  // /sys/fs/cgroup/unified on hybrid systems
+  FILE* file = fopen("/proc/self/mountinfo", "r");
+  if (file == NULL) {
+    return -1;
+  }
+  while (getline(&line, &cap, file) != -1) {
+    char* separator = strstr(line, " - cgroup2 ");
+    if (separator != NULL) {
+      sscanf(line, "%*s %*s %*s %*s %255s", mount);
+      break;
+    }
+  }
+  fclose(file);
+
+  // "0::<path>" is the process's place in the unified hierarchy
+  file = fopen("/proc/self/cgroup", "r");
+  if (file == NULL) {
+    free(line);
+    return -1;
+  }
+  while (getline(&line, &cap, file) != -1) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      snprintf(own, sizeof(own), "%s", line + 3);
+      break;
+    }
+  }
+  fclose(file);
+  free(line);
+
+  if (mount[0] == '\0' || own[0] == '\0') {
+    return -1;
+  }
+  snprintf(path, size, "%s%s", mount, strcmp(own, "/") == 0 ? "" : own);
+  return 0;
+}
+
+
+static int write_cgroup_file(int dir_fd, const char* file, const char* value) {
+  int fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  ssize_t len = strlen(value);
+  int status = write(fd, value, len) == len ? 0 : -1;
+  close(fd);
+  return status;
+}
+
+
+static int open_cgroup_file(int dir_fd, const char* file) {
+  return openat(dir_fd, file, O_RDONLY | O_CLOEXEC);
+}
+
+
+static ssize_t read_cgroup_file(int fd, char* buffer) {
+  if (fd == -1) {
+    return -1;
+  }
+
+  ssize_t len = pread(fd, buffer, CG_BUFFER_SIZE - 1, 0);
+  if (len < 0) {
+    return -1;
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+
+static unsigned long long stat_value(const char* buffer, const char* key) {
+  size_t key_len = strlen(key);
+  const char* line = buffer;
+  while (line != NULL && *line != '\0') {
+    if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') {
+      return strtoull(line + key_len + 1, NULL, 10);
+    }
+    line = strchr(line, '\n');
+    if (line != NULL) {
+      ++line;
+    }
+  }
+  return 0;
+}
+
+
+static unsigned long long io_stat_total(const char* buffer, const char* key) {
+  // "8:0 rbytes=1459200 wbytes=314773504 rios=192 ..."
+  unsigned long long total = 0;
+  size_t key_len = strlen(key);
+  const char* p = buffer;
+  while ((p = strstr(p, key)) != NULL) {
+    if ((p == buffer || p[-1] == ' ') && p[key_len] == '=') {
+      total += strtoull(p + key_len + 1, NULL, 10);
+    }
+    p += key_len;
+  }
+  return total;
+}
@@ -0,0 +1,564 @@
+// ./command_parser.c
+
+// Replaces str_filler. Arguments are never copied: quotes and escapes are
+// removed by compacting each line where it lies, so the arguments of a line
+// end up back to back at its start, each terminated by a NUL. Only the
+// argument vectors are allocated, and those come out of an arena, so a
+// workload of any length costs a handful of allocations
+//
+// A parsed workload can also be compiled to a binary file that is mapped
+// and launched without parsing anything:
+//
+//   compiled_header
+//   compiled_entry    [num_jobs]
+//   uint32_t          [num_args]   offset of each argument in the strings
+//   (padding to 8 bytes)
+//   char              [strings_size]   NUL-terminated arguments
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"command_parser.h"
+
+
+// Constants
+
+// Argument vectors allocated per arena chunk of a loaded workload
+#define WORKLOAD_CHUNK_SIZE (1024 * 1024)
+
+// First bytes of a compiled workload
+#define COMPILED_MAGIC "MCPB"
+
+// Bumped whenever the compiled layout changes
+#define COMPILED_VERSION 2
+
+// Annotations can only name CPUs that fit in job_hints.cpus
+#define MAX_HINT_CPU 63
+
+
+// Types
+
+typedef struct compiled_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_jobs;
+  uint32_t num_args;
+  uint64_t strings_size;
+} compiled_header;
+
+typedef struct compiled_entry {
+  uint32_t first_arg;       // index of the job's first argument offset
+  uint32_t num_args;
+  int32_t priority;
+  int32_t weight;
+  int64_t quantum_us;
+  uint64_t cpus;
+} compiled_entry;
+
+
+// Signatures
+
+// Returns 1 if 'c' separates arguments
+static int is_separator(char c);
+
+// Applies the annotation "name=value" in 'arg' to 'hints', returns -1 if it isn't one we know
+static int parse_annotation(const char* arg, job_hints* hints);
+
+// Parses a CPU list such as "0-3,6" into a bit mask, returns -1 if it is malformed
+static int parse_cpus(const char* str, unsigned long long* cpus);
+
+// Parses all of 'str' as an integer in [min, max], returns -1 otherwise
+static int parse_int(const char* str, long min, long max, long* value);
+
+// Returns the offset of the strings in a compiled workload
+static size_t strings_offset(uint32_t num_jobs, uint32_t num_args);
+
+
+void arena_init(arena* a, size_t chunk_size) {
+  a->head = NULL;
+  a->chunk_size = chunk_size;
+}
+
+
+void* arena_alloc(arena* a, size_t size) {
+  // keep every allocation pointer aligned
+  size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  if (a->head == NULL || a->head->used + size > a->head->size) {
+    size_t chunk_size = size > a->chunk_size ? size : a->chunk_size;
+    arena_chunk* chunk = malloc(sizeof(arena_chunk) + chunk_size);
+    if (chunk == NULL) {
+      fprintf(stderr, "arena allocation failed\n");
+      exit(-1);
+    }
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->next = a->head;
+    a->head = chunk;
+  }
+
+  void* p = a->head->data + a->head->used;
+  a->head->used += size;
+  return p;
+}
+
+
+void arena_reset(arena* a) {
+  if (a->head == NULL) {
+    return;
+  }
+
+  // the oldest chunk is at the end of the list
+  while (a->head->next != NULL) {
+    arena_chunk* next = a->head->next;
+    free(a->head);
+    a->head = next;
+  }
+  a->head->used = 0;
+}
+
+
+void arena_free(arena* a) {
+  while (a->head != NULL) {
+    arena_chunk* next = a->head->next;
+    free(a->head);
+    a->head = next;
+  }
+}
+
+
+int parse_command(arena* a, char* line, command_line* out) {
+  // 'w' never passes 'r', quotes and backslashes only ever shrink a line
+  char* r = line;
+  char* w = line;
+  int num_args = 0;
+
+  while (1) {
+    while (is_separator(*r)) {
+      ++r;
+    }
+    if (*r == '\0') {
+      break;
+    }
+
+    // one argument, quoted and unquoted pieces run together like in sh
+    while (*r != '\0' && !is_separator(*r)) {
+      if (*r == '\'') {
+        // everything up to the closing quote is literal
+        for (++r; *r != '\'' && *r != '\0'; ) {
+          *w++ = *r++;
+        }
+        if (*r == '\0') {
+          return -1;
+        }
+        ++r;
+      }
+      else if (*r == '"') {
+        // only \" and \\ are escapes inside double quotes
+        for (++r; *r != '"' && *r != '\0'; ) {
+          if (*r == '\\' && (r[1] == '"' || r[1] == '\\')) {
+            ++r;
+          }
+          *w++ = *r++;
+        }
+        if (*r == '\0') {
+          return -1;
+        }
+        ++r;
+      }
+      else if (*r == '\\' && r[1] != '\0') {
+        ++r;
+        *w++ = *r++;
+      }
+      else {
+        *w++ = *r++;
+      }
+    }
+
+    // step past the separator first, 'w' may be about to overwrite it
+    if (*r != '\0') {
+      ++r;
+    }
+    *w++ = '\0';
+    ++num_args;
+  }
+
+  // the arguments are packed at the start of the line
+  char** args = arena_alloc(a, sizeof(char*) * (num_args + 1));
+  char* p = line;
+  for (int i = 0; i < num_args; ++i) {
+    args[i] = p;
+    p += strlen(p) + 1;
+  }
+  args[num_args] = NULL;
+
+  out->command_list = args;
+  out->num_token = num_args;
+  return num_args;
+}
+
+
+int parse_job(arena* a, char* line, command_line* out, job_hints* hints) {
+  memset(hints, 0, sizeof(*hints));
+  int num_args = parse_command(a, line, out);
+  if (num_args == -1) {
+    return -1;
+  }
+
+  // annotations only count ahead of the command, its own arguments may start with '@'
+  int skip = 0;
+  while (skip < num_args && out->command_list[skip][0] == '@') {
+    if (parse_annotation(out->command_list[skip] + 1, hints) == -1) {
+      return -2;
+    }
+    ++skip;
+  }
+
+  out->command_list += skip;
+  out->num_token -= skip;
+  return out->num_token;
+}
+
+
+int parse_quantum(const char* str, long* quantum_us) {
+  char* unit;
+  double value = strtod(str, &unit);
+
+  if (unit == str || value <= 0) {
+    return -1;
+  }
+
+  // bare numbers are milliseconds
+  if (*unit == '\0' || strcmp(unit, "ms") == 0) {
+    value *= 1000;
+  }
+  else if (strcmp(unit, "s") == 0) {
+    value *= 1000000;
+  }
+  else if (strcmp(unit, "us") != 0) {
+    return -1;
+  }
+
+  // timerfd would treat a zero timeout as disarming the timer
+  if (value < 1) {
+    return -1;
+  }
+  *quantum_us = (long)value;
+  return 0;
+}
+
+
+int workload_load(workload* w, const char* path) {
+  memset(w, 0, sizeof(*w));
+  arena_init(&w->args, WORKLOAD_CHUNK_SIZE);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    if (fd != -1) {
+      close(fd);
+    }
+    return -1;
+  }
+  w->size = st.st_size;
+
+  // Map one byte more than the file so the last line can always be
+  // terminated in place. A private mapping takes the writes without
+  // touching the file. Reserving anonymous memory first covers a file
+  // that ends exactly on a page boundary
+  w->map_size = w->size + 1;
+  w->data = mmap(NULL, w->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (w->data == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  if (w->size > 0 &&
+      mmap(w->data, w->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(w->data, w->map_size);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  w->data[w->size] = '\0';
+
+  // size the command array with one cheap pass over the newlines
+  int max_commands = 1;
+  for (char* p = w->data; (p = memchr(p, '\n', w->data + w->size - p)) != NULL; ++p) {
+    ++max_commands;
+  }
+  w->commands = arena_alloc(&w->args, sizeof(command_line) * max_commands);
+  w->hints = arena_alloc(&w->args, sizeof(job_hints) * max_commands);
+
+  char* line = w->data;
+  for (int line_num = 1; line < w->data + w->size; ++line_num) {
+    char* end = memchr(line, '\n', w->data + w->size - line);
+    if (end == NULL) {
+      end = w->data + w->size;
+    }
+    *end = '\0';
+
+    command_line* cmd = &w->commands[w->num_commands];
+    int num_args = parse_job(&w->args, line, cmd, &w->hints[w->num_commands]);
+    if (num_args == -1) {
+      fprintf(stderr, "%s:%d: unterminated quote, skipping line\n", path, line_num);
+    }
+    else if (num_args == -2) {
+      fprintf(stderr, "%s:%d: bad annotation, skipping line\n", path, line_num);
+    }
+    else if (num_args > 0) {
+      ++w->num_commands;
+    }
+    line = end + 1;
+  }
+  return 0;
+}
+
+
+void workload_free(workload* w) {
+  if (w->data != NULL) {
+    munmap(w->data, w->map_size);
+    w->data = NULL;
+  }
+  arena_free(&w->args);
+  w->commands = NULL;
+  w->num_commands = 0;
+}
+
+
+int workload_compile(workload* w, const char* path) {
+  compiled_header header;
+  memcpy(header.magic, COMPILED_MAGIC, 4);
+  header.version = COMPILED_VERSION;
+  header.num_jobs = w->num_commands;
+  header.num_args = 0;
+  header.strings_size = 0;
+  for (int i = 0; i < w->num_commands; ++i) {
+    header.num_args += w->commands[i].num_token;
+    for (int j = 0; j < w->commands[i].num_token; ++j) {
+      header.strings_size += strlen(w->commands[i].command_list[j]) + 1;
+    }
+  }
+
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    return -1;
+  }
+  fwrite(&header, sizeof(header), 1, out);
+
+  uint32_t first_arg = 0;
+  for (int i = 0; i < w->num_commands; ++i) {
+    compiled_entry job = {0};
+    job.first_arg = first_arg;
+    job.num_args = w->commands[i].num_token;
+    job.priority = w->hints[i].priority;
+    job.weight = w->hints[i].weight;
+    job.quantum_us = w->hints[i].quantum_us;
+    job.cpus = w->hints[i].cpus;
+    fwrite(&job, sizeof(job), 1, out);
+    first_arg += job.num_args;
+  }
+
+  uint32_t offset = 0;
+  for (int i = 0; i < w->num_commands; ++i) {
+    for (int j = 0; j < w->commands[i].num_token; ++j) {
+      fwrite(&offset, sizeof(offset), 1, out);
+      offset += strlen(w->commands[i].command_list[j]) + 1;
+    }
+  }
+
+  // pad so the strings start where compiled_open expects them
+  static const char padding[8] = {0};
+  size_t written = sizeof(header) + sizeof(compiled_entry) * header.num_jobs + sizeof(uint32_t) * header.num_args;
+  fwrite(padding, 1, strings_offset(header.num_jobs, header.num_args) - written, out);
+
+  for (int i = 0; i < w->num_commands; ++i) {
+    for (int j = 0; j < w->commands[i].num_token; ++j) {
+      fputs(w->commands[i].command_list[j], out);
+      fputc('\0', out);
+    }
+  }
+
+  if (ferror(out)) {
+    fclose(out);
+    return -1;
+  }
+  return fclose(out) == 0 ? 0 : -1;
+}
+
+
+int compiled_open(compiled_workload* c, const char* path) {
+  memset(c, 0, sizeof(*c));
+
+  // only look inside regular files, opening a FIFO would wait for a writer
+  struct stat st;
+  if (stat(path, &st) == -1 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(compiled_header)) {
+    return 0;
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return 0;
+  }
+  char magic[4];
+  if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic) || memcmp(magic, COMPILED_MAGIC, 4) != 0) {
+    close(fd);
+    return 0;
+  }
+
+  c->size = st.st_size;
+  c->data = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (c->data == MAP_FAILED) {
+    c->data = NULL;
+    return -1;
+  }
+
+  // the sections have to add up to the file exactly, and the last
+  // string must be terminated
+  compiled_header* header = (compiled_header*)c->data;
+  size_t strings = strings_offset(header->num_jobs, header->num_args);
+  if (header->version != COMPILED_VERSION || strings > c->size ||
+      c->size - strings != header->strings_size ||
+      (header->strings_size > 0 && c->data[c->size - 1] != '\0')) {
+    compiled_close(c);
+    return -1;
+  }
+
+  c->num_jobs = header->num_jobs;
+  return 1;
+}
+
+
+int compiled_job(compiled_workload* c, arena* a, int index, command_line* out, job_hints* hints) {
+  compiled_header* header = (compiled_header*)c->data;
+  compiled_entry* job = (compiled_entry*)(c->data + sizeof(compiled_header)) + index;
+  uint32_t* offsets = (uint32_t*)((compiled_entry*)(c->data + sizeof(compiled_header)) + header->num_jobs);
+  char* strings = c->data + strings_offset(header->num_jobs, header->num_args);
+
+  if (job->num_args == 0 || job->first_arg > header->num_args || job->num_args > header->num_args - job->first_arg) {
+    return -1;
+  }
+
+  // no parsing, just turn offsets into pointers
+  char** args = arena_alloc(a, sizeof(char*) * (job->num_args + 1));
+  for (uint32_t i = 0; i < job->num_args; ++i) {
+    uint32_t offset = offsets[job->first_arg + i];
+    if (offset >= header->strings_size) {
+      return -1;
+    }
+    args[i] = strings + offset;
+  }
+  args[job->num_args] = NULL;
+
+  out->command_list = args;
+  out->num_token = job->num_args;
+  hints->priority = job->priority;
+  hints->weight = job->weight;
+  hints->quantum_us = job->quantum_us;
+  hints->cpus = job->cpus;
+  return 0;
+}
+
+
+void compiled_close(compiled_workload* c) {
+  if (c->data != NULL) {
+    munmap(c->data, c->size);
+    c->data = NULL;
+  }
+  c->num_jobs = 0;
+}
+
+
+static int parse_annotation(const char* arg, job_hints* hints) {
+  const char* value = strchr(arg, '=');
+  if (value == NULL) {
+    return -1;
+  }
+  size_t name_len = value++ - arg;
+  long n;
+
+  if (name_len == 4 && strncmp(arg, "prio", 4) == 0) {
+    if (parse_int(value, -1000, 1000, &n) == -1) {
+      return -1;
+    }
+    hints->priority = n;
+  }
+  else if (name_len == 6 && strncmp(arg, "weight", 6) == 0) {
+    if (parse_int(value, 1, 10000, &n) == -1) {
+      return -1;
+    }
+    hints->weight = n;
+  }
+  else if (name_len == 7 && strncmp(arg, "quantum", 7) == 0) {
+    return parse_quantum(value, &hints->quantum_us);
+  }
+  else if (name_len == 4 && strncmp(arg, "cpus", 4) == 0) {
+    return parse_cpus(value, &hints->cpus);
+  }
+  else {
+    return -1;
+  }
+  return 0;
+}
+
+
+static int parse_cpus(const char* str, unsigned long long* cpus) {
+  *cpus = 0;
+
+  // comma separated CPUs or first-last ranges
+  while (1) {
+    char* end;
+    long first = strtol(str, &end, 10);
+    long last = first;
+    if (end == str) {
+      return -1;
+    }
+    if (*end == '-') {
+      str = end + 1;
+      last = strtol(str, &end, 10);
+      if (end == str) {
+        return -1;
+      }
+    }
+    if (first < 0 || last < first || last > MAX_HINT_CPU) {
+      return -1;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      *cpus |= 1ULL << cpu;
+    }
+
+    if (*end == '\0') {
+      return 0;
+    }
+    if (*end != ',') {
+      return -1;
+    }
+    str = end + 1;
+  }
+}
+
+
+static int parse_int(const char* str, long min, long max, long* value) {
+  char* end;
+  *value = strtol(str, &end, 10);
+  if (end == str || *end != '\0' || *value < min || *value > max) {
+    return -1;
+  }
+  return 0;
+}
+
+
+static int is_separator(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+static size_t strings_offset(uint32_t num_jobs, uint32_t num_args) {
+  size_t offset = sizeof(compiled_header) + sizeof(compiled_entry) * (size_t)num_jobs + sizeof(uint32_t) * (size_t)num_args;
+  return (offset + 7) & ~(size_t)7;
+}
@@ -0,0 +1,107 @@
+// ./command_parser.h
+
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include<stddef.h>
+
+
+// Types
+
+// A parsed command, 'command_list' is NULL-terminated for execvp
+typedef struct command_line {
+  char** command_list;
+  int num_token;
+} command_line;
+
+// Scheduling hints for one job, set by annotations such as
+// "@prio=5 @weight=3 @cpus=0-3 @quantum=20ms" ahead of the command.
+// 0 where the workload gives none
+typedef struct job_hints {
+  int priority;             // higher runs first under the stride policy
+  int weight;               // share of the CPU relative to other jobs
+  long quantum_us;          // base quantum, overrides the scheduler's
+  unsigned long long cpus;  // bit n set if the job may run on CPU n
+} job_hints;
+
+// Bump allocator, everything in it is freed at once
+typedef struct arena_chunk {
+  struct arena_chunk* next;
+  size_t size;
+  size_t used;
+  char data[];
+} arena_chunk;
+
+typedef struct arena {
+  arena_chunk* head;        // chunk being allocated from, older ones follow
+  size_t chunk_size;
+} arena;
+
+// A whole workload file mapped into memory and parsed in place. The
+// arguments of every command point into 'data', their vectors live in 'args'
+typedef struct workload {
+  char* data;
+  size_t size;
+  size_t map_size;
+  arena args;
+  command_line* commands;
+  job_hints* hints;         // one per command
+  int num_commands;
+} workload;
+
+// A workload written by workload_compile, mapped read-only. Arguments
+// are handed to execvp straight out of the mapping
+typedef struct compiled_workload {
+  char* data;
+  size_t size;
+  int num_jobs;
+} compiled_workload;
+
+
+// Signatures
+
+// Initializes an empty arena that allocates 'chunk_size' bytes at a time
+void arena_init(arena* a, size_t chunk_size);
+
+// Returns 'size' bytes from 'a', exits if out of memory
+void* arena_alloc(arena* a, size_t size);
+
+// Forgets every allocation but keeps the first chunk for reuse
+void arena_reset(arena* a);
+
+// Frees every chunk of 'a'
+void arena_free(arena* a);
+
+// Splits the NUL-terminated 'line' in place into 'out', with its vector
+// allocated from 'a'. Handles 'single' and "double" quotes and backslash
+// escapes. Returns the number of arguments, or -1 if a quote is left open
+int parse_command(arena* a, char* line, command_line* out);
+
+// Like parse_command, then strips the leading @annotations into 'hints'.
+// Returns -1 if a quote is left open and -2 for an unknown or bad annotation
+int parse_job(arena* a, char* line, command_line* out, job_hints* hints);
+
+// Parses a time such as "500us", "20ms" or "1s" into microseconds, bare numbers are milliseconds
+int parse_quantum(const char* str, long* quantum_us);
+
+// Maps 'path' and parses every non-blank line into 'w', returns -1 if it can't be read
+int workload_load(workload* w, const char* path);
+
+// Unmaps the file and frees the commands of 'w'
+void workload_free(workload* w);
+
+// Writes 'w' to 'path' in the compiled format, returns -1 on failure
+int workload_compile(workload* w, const char* path);
+
+// Maps the compiled workload 'path'. Returns 1 on success, 0 if 'path' is
+// not a compiled workload and -1 if it is one but is damaged
+int compiled_open(compiled_workload* c, const char* path);
+
+// Points 'out' at the arguments of job 'index', with its vector allocated
+// from 'a', and copies its hints. Returns -1 if the job is damaged
+int compiled_job(compiled_workload* c, arena* a, int index, command_line* out, job_hints* hints);
+
+// Unmaps 'c'
+void compiled_close(compiled_workload* c);
+
+#endif
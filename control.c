@@ -0,0 +1,226 @@
+// ./control.c
+
+// Unix socket the running MCP answers requests on, served from the event
+// loop like everything else. A client connects, writes one request line
+// and reads the reply until the MCP closes the connection, e.g.
+//   echo json | nc -U /tmp/mcp.sock
+// Every socket is non-blocking and replies go out as the client reads
+// them, so a slow or stuck client costs a buffer, never a stalled tick.
+// What requests mean is up to the 'serve' callback
+
+#define _GNU_SOURCE // accept4
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<sys/epoll.h>
+#include"MCP.h"
+
+
+// Signatures
+
+// Accepts every pending connection, refusing those beyond CONTROL_MAX_CLIENTS
+static void accept_clients(control_server* srv, int epoll_fd);
+
+// Reads the request of 'c' and answers it once the line is complete
+static void read_request(int epoll_fd, control_client* c,
+  char* (*serve)(const char* request, size_t* len, void* ctx), void* ctx);
+
+// Sends as much of the reply as the socket takes, closes the connection once it is all out
+static void write_reply(int epoll_fd, control_client* c);
+
+// Closes the connection of 'c' and frees its entry
+static void drop_client(int epoll_fd, control_client* c);
+
+
+int control_open(control_server* srv, const char* path, int epoll_fd) {
+  struct sockaddr_un addr = {0};
+  srv->listen_fd = -1;
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+    srv->clients[i].fd = -1;
+    srv->clients[i].reply = NULL;
+  }
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  snprintf(srv->path, sizeof(srv->path), "%s", path);
+
+  // a socket left behind by an earlier run would make bind fail
+  unlink(path);
+  srv->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (srv->listen_fd == -1 ||
+      bind(srv->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+      listen(srv->listen_fd, CONTROL_MAX_CLIENTS) == -1) {
+    control_close(srv, epoll_fd);
+    return -1;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = srv->listen_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev);
+  return 0;
+}
+
+
+void control_close(control_server* srv, int epoll_fd) {
+  if (srv->listen_fd == -1) {
+    return;
+  }
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+    drop_client(epoll_fd, &srv->clients[i]);
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, srv->listen_fd, NULL);
+  close(srv->listen_fd);
+  srv->listen_fd = -1;
+  unlink(srv->path);
+}
+
+
+int control_owns(control_server* srv, int fd) {
+  if (srv->listen_fd == -1) {
+    return 0;
+  }
+  if (fd == srv->listen_fd) {
+    return 1;
+  }
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+    if (srv->clients[i].fd == fd) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+void control_handle(control_server* srv, int epoll_fd, int fd, uint32_t events,
+  char* (*serve)(const char* request, size_t* len, void* ctx), void* ctx) {
+  if (fd == srv->listen_fd) {
+    accept_clients(srv, epoll_fd);
+    return;
+  }
+
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+    control_client* c = &srv->clients[i];
+    if (c->fd != fd) {
+      continue;
+    }
+    if (c->reply != NULL) {
+      write_reply(epoll_fd, c);
+    }
+    else if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      read_request(epoll_fd, c, serve, ctx);
+    }
+    return;
+  }
+}
+
+
+static void accept_clients(control_server* srv, int epoll_fd) {
+  int fd;
+  while ((fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    control_client* c = NULL;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS && c == NULL; ++i) {
+      if (srv->clients[i].fd == -1) {
+        c = &srv->clients[i];
+      }
+    }
+
+    // busy, the client sees the connection close without a reply
+    if (c == NULL) {
+      close(fd);
+      continue;
+    }
+
+    c->fd = fd;
+    c->request_len = 0;
+    c->reply = NULL;
+    c->reply_len = 0;
+    c->sent = 0;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+
+static void read_request(int epoll_fd, control_client* c,
+  char* (*serve)(const char* request, size_t* len, void* ctx), void* ctx) {
+  ssize_t n;
+  int eof = 0;
+  while ((n = read(c->fd, c->request + c->request_len, sizeof(c->request) - 1 - c->request_len)) > 0) {
+    c->request_len += n;
+    if (c->request_len == sizeof(c->request) - 1) {
+      break;
+    }
+  }
+  if (n == 0) {
+    eof = 1;
+  }
+  else if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    drop_client(epoll_fd, c);
+    return;
+  }
+
+  // wait for the rest of the line unless the client is done writing
+  c->request[c->request_len] = '\0';
+  char* newline = strchr(c->request, '\n');
+  if (newline == NULL && !eof && c->request_len < sizeof(c->request) - 1) {
+    return;
+  }
+  if (newline != NULL) {
+    *newline = '\0';
+  }
+  if (newline != NULL && newline > c->request && newline[-1] == '\r') {
+    newline[-1] = '\0';
+  }
+
+  c->reply = serve(c->request, &c->reply_len, ctx);
+  if (c->reply == NULL) {
+    drop_client(epoll_fd, c);
+    return;
+  }
+
+  // the reply goes out as the socket drains
+  struct epoll_event ev;
+  ev.events = EPOLLOUT;
+  ev.data.fd = c->fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+  write_reply(epoll_fd, c);
+}
+
+
+static void write_reply(int epoll_fd, control_client* c) {
+  while (c->sent < c->reply_len) {
+    // a client that hung up must not take the MCP down with SIGPIPE
+    ssize_t n = send(c->fd, c->reply + c->sent, c->reply_len - c->sent, MSG_NOSIGNAL);
+    if (n == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      break;
+    }
+    c->sent += n;
+  }
+  drop_client(epoll_fd, c);
+}
+
+
+static void drop_client(int epoll_fd, control_client* c) {
+  if (c->fd == -1) {
+    return;
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
+  free(c->reply);
+  c->reply = NULL;
+}
@@ -14,6 +14,10 @@ int main(int argc, char **argv) {
  */
     for (i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-seconds") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value for `%s'\n", argv[i]);
+                exit(1);
+            }
             seconds = atoi(argv[i + 1]);
             break;
         } else {
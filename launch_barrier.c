@@ -0,0 +1,72 @@
+// ./launch_barrier.c
+
+// Replaces the SIGUSR1 + sleep() start gate. The parent knows exactly
+// when every child is ready instead of guessing with a fixed delay, and
+// releasing is one close() no matter how many children are waiting
+
+#define _GNU_SOURCE
+
+#include<stdio.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include"launch_barrier.h"
+
+
+int barrier_init(launch_barrier* b) {
+  // close-on-exec so the workloads never inherit the pipes
+  if (pipe2(b->ready, O_CLOEXEC) == -1) {
+    return -1;
+  }
+  if (pipe2(b->go, O_CLOEXEC) == -1) {
+    close(b->ready[0]);
+    close(b->ready[1]);
+    return -1;
+  }
+  return 0;
+}
+
+
+void barrier_child_wait(launch_barrier* b) {
+  // the go pipe only reaches EOF once no write end is left open, so the
+  // child drops the copy it inherited
+  close(b->ready[0]);
+  close(b->go[1]);
+
+  char c = 'r';
+  while (write(b->ready[1], &c, 1) == -1 && errno == EINTR);
+  close(b->ready[1]);
+
+  // returns 0 (EOF) when the parent releases the barrier
+  while (read(b->go[0], &c, 1) == -1 && errno == EINTR);
+  close(b->go[0]);
+}
+
+
+int barrier_wait_ready(launch_barrier* b, int count) {
+  // after this only the children hold the write end, so a child that
+  // dies before checking in can't leave the parent blocked forever
+  close(b->ready[1]);
+
+  char buffer[256];
+  int checked_in = 0;
+  while (checked_in < count) {
+    int want = count - checked_in < (int)sizeof(buffer) ? count - checked_in : (int)sizeof(buffer);
+    ssize_t n = read(b->ready[0], buffer, want);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    checked_in += n;
+  }
+  close(b->ready[0]);
+  return checked_in;
+}
+
+
+void barrier_release(launch_barrier* b) {
+  close(b->go[0]);
+  close(b->go[1]);
+}
@@ -0,0 +1,33 @@
+// ./launch_barrier.h
+
+#ifndef LAUNCH_BARRIER_H
+#define LAUNCH_BARRIER_H
+
+
+// Types
+
+// Start gate for forked workloads. Each child writes one byte to 'ready'
+// and blocks reading 'go'; the parent waits for every byte, then closes
+// its end of 'go' so all the reads return at once
+typedef struct launch_barrier {
+  int ready[2];             // children -> parent, one byte per child
+  int go[2];                // parent -> children, closed to release them
+} launch_barrier;
+
+
+// Signatures
+
+// Creates the pipes, call before forking the children, returns -1 on failure
+int barrier_init(launch_barrier* b);
+
+// Child side: checks in, then blocks until the parent releases the barrier
+void barrier_child_wait(launch_barrier* b);
+
+// Parent side: blocks until 'count' children checked in or every child
+// that could has died, returns the number that checked in
+int barrier_wait_ready(launch_barrier* b, int count);
+
+// Parent side: lets every waiting child go on to execvp
+void barrier_release(launch_barrier* b);
+
+#endif
@@ -0,0 +1,157 @@
+// ./line_reader.c
+
+// Reads the workload one line at a time from a file, FIFO or stdin as the
+// lines arrive, instead of counting them first and reading the file twice.
+// Lines are handed out in place, so a line costs no allocations once the
+// buffer has grown to fit it
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<poll.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Initial size of the line buffer, doubled whenever a line doesn't fit
+#define LINE_BUFFER_SIZE 65536
+
+
+// Signatures
+
+// Returns the length of the complete line at the start of the unread data, 0 if there is none yet
+static size_t find_line(line_reader* r);
+
+// Reads more input into the buffer, returns the number of bytes read, 0 at the end of the input or -1 if none are available yet
+static ssize_t fill_buffer(line_reader* r);
+
+
+int line_reader_open(line_reader* r, const char* path) {
+  memset(r, 0, sizeof(*r));
+
+  // "-" reads the workload from stdin
+  if (strcmp(path, "-") == 0) {
+    r->fd = STDIN_FILENO;
+  }
+  else {
+    // opening a FIFO waits here for the first writer
+    r->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (r->fd == -1) {
+      return -1;
+    }
+  }
+
+  r->cap = LINE_BUFFER_SIZE;
+  r->buffer = malloc(r->cap);
+  if (r->buffer == NULL) {
+    fprintf(stderr, "line reader allocation failed\n");
+    exit(-1);
+  }
+  return 0;
+}
+
+
+void line_reader_close(line_reader* r) {
+  if (r->fd != -1) {
+    if (r->fd != STDIN_FILENO) {
+      close(r->fd);
+    }
+    r->fd = -1;
+  }
+  free(r->buffer);
+  r->buffer = NULL;
+}
+
+
+int line_reader_next(line_reader* r, char** line) {
+  size_t len;
+
+  while ((len = find_line(r)) == 0) {
+    if (r->at_eof) {
+      // hand out a last line without a trailing newline, then we're done
+      if (r->start < r->end) {
+        len = r->end - r->start;
+        r->buffer[r->end] = '\0';
+        break;
+      }
+      r->done = 1;
+      return -1;
+    }
+    if (fill_buffer(r) == -1) {
+      return 0;
+    }
+  }
+
+  // terminate in place over the newline, the line stays valid until the next call
+  *line = r->buffer + r->start;
+  if ((*line)[len - 1] == '\n') {
+    (*line)[len - 1] = '\0';
+  }
+  r->start += len;
+  r->scanned = r->start;
+  return 1;
+}
+
+
+static size_t find_line(line_reader* r) {
+  // only scan what arrived since the last look
+  char* newline = memchr(r->buffer + r->scanned, '\n', r->end - r->scanned);
+  if (newline == NULL) {
+    r->scanned = r->end;
+    return 0;
+  }
+  return newline - (r->buffer + r->start) + 1;
+}
+
+
+static ssize_t fill_buffer(line_reader* r) {
+  // move the partial line to the front
+  if (r->start > 0) {
+    memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->scanned -= r->start;
+    r->start = 0;
+  }
+
+  // a line longer than the buffer, keep one byte for the terminator
+  if (r->end + 1 >= r->cap) {
+    r->cap *= 2;
+    r->buffer = realloc(r->buffer, r->cap);
+    if (r->buffer == NULL) {
+      fprintf(stderr, "line reader allocation failed\n");
+      exit(-1);
+    }
+  }
+
+  // stdin's open file description may be shared with the shell, so the fd
+  // stays blocking and is only read once poll says it won't block
+  struct pollfd pfd = {r->fd, POLLIN, 0};
+  int ready;
+  do {
+    ready = poll(&pfd, 1, 0);
+  } while (ready == -1 && errno == EINTR);
+  if (ready == 0) {
+    return -1;
+  }
+
+  ssize_t n;
+  do {
+    n = read(r->fd, r->buffer + r->end, r->cap - r->end - 1);
+  } while (n == -1 && errno == EINTR);
+
+  if (n > 0) {
+    r->end += n;
+    return n;
+  }
+
+  // nothing more right now, anything else ends the input
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return -1;
+  }
+  r->at_eof = 1;
+  return 0;
+}
@@ -0,0 +1,339 @@
+// ./netlink_acct.c
+
+// Accounting through netlink instead of polling /proc. Three sockets:
+//  - query: TASKSTATS_CMD_GET for one pid's CPU, I/O and delay counters
+//  - exit: registered for every CPU, the kernel sends each exiting
+//    process's final taskstats here without being asked
+//  - connector: proc connector fork/exec events (optional)
+// Both taskstats and the connector need CAP_NET_ADMIN, netlink_acct_open
+// fails without it and the MCP falls back to /proc
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<linux/netlink.h>
+#include<linux/genetlink.h>
+#include<linux/taskstats.h>
+#include<linux/connector.h>
+#include<linux/cn_proc.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Large enough for any single taskstats or connector message batch
+#define NL_BUFFER_SIZE 8192
+
+// Room for the attributes of any request we send
+#define NL_REQUEST_SIZE 256
+
+
+// Types
+
+// A generic netlink request
+typedef struct genl_request {
+  struct nlmsghdr n;
+  struct genlmsghdr g;
+  char attrs[NL_REQUEST_SIZE];
+} genl_request;
+
+
+// Signatures
+
+// Opens a netlink socket of 'protocol' bound to multicast 'groups'
+static int nl_open(int protocol, unsigned int groups);
+
+// Sends generic netlink 'cmd' to 'family' with a single attribute
+static int genl_send(int fd, unsigned int* seq, int family, int cmd, int attr_type, const void* data, int len);
+
+// Looks up the id of the generic netlink family 'name'
+static int genl_family_id(int fd, unsigned int* seq, const char* name);
+
+// Returns the first attribute in a generic netlink message
+static struct nlattr* genl_attrs(struct nlmsghdr* n);
+
+// Parses an AGGR_PID attribute into 'ev' as an exit record
+static int parse_aggr_pid(struct nlmsghdr* n, acct_event* ev);
+
+// Copies the counters of 'stats' into 'out'
+static void taskstats_to_sample(struct taskstats* stats, int len, proc_sample* out);
+
+// Subscribes 'fd' to the proc connector
+static int connector_listen(int fd);
+
+
+// Globals
+
+static char nl_buffer[NL_BUFFER_SIZE];
+
+
+int netlink_acct_open(netlink_acct* acct) {
+  acct->query_fd = nl_open(NETLINK_GENERIC, 0);
+  acct->exit_fd = nl_open(NETLINK_GENERIC, 0);
+  acct->connector_fd = -1;
+  acct->seq = 0;
+
+  if (acct->query_fd == -1 || acct->exit_fd == -1) {
+    netlink_acct_close(acct);
+    return -1;
+  }
+
+  acct->family_id = genl_family_id(acct->query_fd, &acct->seq, TASKSTATS_GENL_NAME);
+  if (acct->family_id == -1) {
+    netlink_acct_close(acct);
+    return -1;
+  }
+
+  // final totals of every process exiting on any CPU
+  char cpumask[32];
+  snprintf(cpumask, sizeof(cpumask), "0-%ld", sysconf(_SC_NPROCESSORS_CONF) - 1);
+  if (genl_send(acct->exit_fd, &acct->seq, acct->family_id, TASKSTATS_CMD_GET,
+                TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, cpumask, strlen(cpumask) + 1) == -1) {
+    netlink_acct_close(acct);
+    return -1;
+  }
+
+  // try a query on ourselves, this is where missing CAP_NET_ADMIN shows up
+  proc_sample self;
+  if (netlink_sample(acct, getpid(), &self) == -1) {
+    netlink_acct_close(acct);
+    return -1;
+  }
+
+  // fork/exec events are a bonus, carry on without them
+  acct->connector_fd = nl_open(NETLINK_CONNECTOR, CN_IDX_PROC);
+  if (acct->connector_fd != -1 && connector_listen(acct->connector_fd) == -1) {
+    close(acct->connector_fd);
+    acct->connector_fd = -1;
+  }
+  return 0;
+}
+
+
+void netlink_acct_close(netlink_acct* acct) {
+  int* fds[] = {&acct->query_fd, &acct->exit_fd, &acct->connector_fd};
+  for (int i = 0; i < 3; ++i) {
+    if (*fds[i] != -1) {
+      close(*fds[i]);
+      *fds[i] = -1;
+    }
+  }
+}
+
+
+int netlink_sample(netlink_acct* acct, pid_t pid, proc_sample* out) {
+  __u32 query_pid = pid;
+  if (genl_send(acct->query_fd, &acct->seq, acct->family_id, TASKSTATS_CMD_GET,
+                TASKSTATS_CMD_ATTR_PID, &query_pid, sizeof(query_pid)) == -1) {
+    return -1;
+  }
+
+  ssize_t len = recv(acct->query_fd, nl_buffer, sizeof(nl_buffer), 0);
+  struct nlmsghdr* n = (struct nlmsghdr*)nl_buffer;
+  if (len <= 0 || !NLMSG_OK(n, len) || n->nlmsg_type == NLMSG_ERROR) {
+    return -1;
+  }
+
+  acct_event ev;
+  if (parse_aggr_pid(n, &ev) == -1) {
+    return -1;
+  }
+  *out = ev.totals;
+  return 0;
+}
+
+
+int netlink_drain(netlink_acct* acct, int fd, void (*handle)(acct_event* ev, void* ctx), void* ctx) {
+  ssize_t len;
+  int handled = 0;
+
+  while ((len = recv(fd, nl_buffer, sizeof(nl_buffer), MSG_DONTWAIT)) > 0) {
+    for (struct nlmsghdr* n = (struct nlmsghdr*)nl_buffer; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+      acct_event ev;
+      memset(&ev, 0, sizeof(ev));
+
+      if (fd == acct->exit_fd) {
+        if (n->nlmsg_type != acct->family_id || parse_aggr_pid(n, &ev) == -1) {
+          continue;
+        }
+        ev.type = ACCT_EXIT;
+      }
+      else {
+        struct cn_msg* cn = NLMSG_DATA(n);
+        struct proc_event* pe = (struct proc_event*)cn->data;
+        switch (pe->what) {
+          case PROC_EVENT_FORK:
+            ev.type = ACCT_FORK;
+            ev.pid = pe->event_data.fork.child_tgid;
+            ev.parent = pe->event_data.fork.parent_tgid;
+            break;
+          case PROC_EVENT_EXEC:
+            ev.type = ACCT_EXEC;
+            ev.pid = pe->event_data.exec.process_tgid;
+            break;
+          // exits come with their totals on the exit socket
+          default:
+            continue;
+        }
+      }
+
+      handle(&ev, ctx);
+      ++handled;
+    }
+  }
+
+  if (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+    return -1;
+  }
+  return handled;
+}
+
+
+static int nl_open(int protocol, unsigned int groups) {
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, protocol);
+  if (fd == -1) {
+    return -1;
+  }
+
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = groups;
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+static int genl_send(int fd, unsigned int* seq, int family, int cmd, int attr_type, const void* data, int len) {
+  genl_request req;
+  memset(&req, 0, sizeof(req));
+
+  req.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+  req.n.nlmsg_type = family;
+  req.n.nlmsg_flags = NLM_F_REQUEST;
+  req.n.nlmsg_seq = ++(*seq);
+  req.g.cmd = cmd;
+  req.g.version = 1;
+
+  // single attribute right after the generic netlink header
+  struct nlattr* na = (struct nlattr*)((char*)&req + NLMSG_ALIGN(req.n.nlmsg_len));
+  na->nla_type = attr_type;
+  na->nla_len = NLA_HDRLEN + len;
+  memcpy((char*)na + NLA_HDRLEN, data, len);
+  req.n.nlmsg_len = NLMSG_ALIGN(req.n.nlmsg_len) + NLA_ALIGN(na->nla_len);
+
+  struct sockaddr_nl kernel;
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+
+  if (sendto(fd, &req, req.n.nlmsg_len, 0, (struct sockaddr*)&kernel, sizeof(kernel)) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+static int genl_family_id(int fd, unsigned int* seq, const char* name) {
+  if (genl_send(fd, seq, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME, name, strlen(name) + 1) == -1) {
+    return -1;
+  }
+
+  ssize_t len = recv(fd, nl_buffer, sizeof(nl_buffer), 0);
+  struct nlmsghdr* n = (struct nlmsghdr*)nl_buffer;
+  if (len <= 0 || !NLMSG_OK(n, len) || n->nlmsg_type == NLMSG_ERROR) {
+    return -1;
+  }
+
+  // walk the attributes for the family id
+  struct nlattr* na = genl_attrs(n);
+  int remaining = n->nlmsg_len - ((char*)na - (char*)n);
+  while (remaining >= NLA_HDRLEN && na->nla_len >= NLA_HDRLEN) {
+    if (na->nla_type == CTRL_ATTR_FAMILY_ID) {
+      return *(__u16*)((char*)na + NLA_HDRLEN);
+    }
+    remaining -= NLA_ALIGN(na->nla_len);
+    na = (struct nlattr*)((char*)na + NLA_ALIGN(na->nla_len));
+  }
+  return -1;
+}
+
+
+static struct nlattr* genl_attrs(struct nlmsghdr* n) {
+  return (struct nlattr*)((char*)NLMSG_DATA(n) + GENL_HDRLEN);
+}
+
+
+static int parse_aggr_pid(struct nlmsghdr* n, acct_event* ev) {
+  memset(ev, 0, sizeof(*ev));
+
+  // AGGR_PID nests the pid followed by its taskstats
+  struct nlattr* aggr = genl_attrs(n);
+  if (aggr->nla_type != TASKSTATS_TYPE_AGGR_PID) {
+    return -1;
+  }
+
+  struct nlattr* na = (struct nlattr*)((char*)aggr + NLA_HDRLEN);
+  int remaining = aggr->nla_len - NLA_HDRLEN;
+  while (remaining >= NLA_HDRLEN && na->nla_len >= NLA_HDRLEN) {
+    void* data = (char*)na + NLA_HDRLEN;
+    if (na->nla_type == TASKSTATS_TYPE_PID) {
+      ev->pid = *(__u32*)data;
+    }
+    else if (na->nla_type == TASKSTATS_TYPE_STATS) {
+      struct taskstats* stats = data;
+      taskstats_to_sample(stats, na->nla_len - NLA_HDRLEN, &ev->totals);
+      ev->parent = stats->ac_ppid;
+      ev->exit_code = stats->ac_exitcode;
+      return 0;
+    }
+    remaining -= NLA_ALIGN(na->nla_len);
+    na = (struct nlattr*)((char*)na + NLA_ALIGN(na->nla_len));
+  }
+  return -1;
+}
+
+
+static void taskstats_to_sample(struct taskstats* stats, int len, proc_sample* out) {
+  // older or newer kernels send a different sized struct
+  struct taskstats copy;
+  memset(&copy, 0, sizeof(copy));
+  memcpy(&copy, stats, len < (int)sizeof(copy) ? len : (int)sizeof(copy));
+
+  memset(out, 0, sizeof(*out));
+  strncpy(out->name, copy.ac_comm, sizeof(out->name) - 1);
+  // taskstats has no run state
+  out->state = '-';
+  out->utime = copy.ac_utime / 1e6;
+  out->stime = copy.ac_stime / 1e6;
+  out->rchar = copy.read_char;
+  out->wchar = copy.write_char;
+  out->voluntary_switches = copy.nvcsw;
+  out->involuntary_switches = copy.nivcsw;
+  out->cpu_delay_ns = copy.cpu_delay_total;
+  out->blkio_delay_ns = copy.blkio_delay_total;
+}
+
+
+static int connector_listen(int fd) {
+  char buffer[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+  memset(buffer, 0, sizeof(buffer));
+
+  struct nlmsghdr* n = (struct nlmsghdr*)buffer;
+  n->nlmsg_len = sizeof(buffer);
+  n->nlmsg_type = NLMSG_DONE;
+  n->nlmsg_pid = getpid();
+
+  struct cn_msg* cn = NLMSG_DATA(n);
+  cn->id.idx = CN_IDX_PROC;
+  cn->id.val = CN_VAL_PROC;
+  cn->len = sizeof(enum proc_cn_mcast_op);
+  *(enum proc_cn_mcast_op*)cn->data = PROC_CN_MCAST_LISTEN;
+
+  return send(fd, buffer, sizeof(buffer), 0) == -1 ? -1 : 0;
+}
@@ -5,7 +5,7 @@
 #include<unistd.h> // fork, execvp
 #include<sys/types.h>
 #include<sys/wait.h>
-#include"string_parser.h"
+#include"command_parser.h"
 
 
 // Signatures
@@ -21,22 +21,16 @@ int main(int argc, char const *argv[]) {
     return 0;
   }
 
-  char *input = NULL;
-  size_t len = 0;
-  
-
-  // open file for reading
-  freopen(argv[1], "r", stdin);
-
-  // command_line token_buffer;
-  // token_buffer = str_filler(input, " ");
+  // map the file and parse every line in place
+  workload jobs;
+  if (workload_load(&jobs, argv[1]) == -1) {
+    fprintf(stderr, "can't read '%s'\n", argv[1]);
+    exit(-1);
+  }
 
-  while(getline(&input, &len, stdin) != -1) {
+  for (int i = 0; i < jobs.num_commands; ++i) {
     
-    command_line token_buffer;
-    int line_num = 0;
-
-    token_buffer = str_filler(input, " ");
+    command_line token_buffer = jobs.commands[i];
     // print_command_line(&token_buffer);
 
     // for each cmd, mcp must launch the separate proc to run the cmd
@@ -44,8 +38,7 @@ int main(int argc, char const *argv[]) {
 
     if (child_process < 0) {
       fprintf(stderr, "fork failed\n");
-      free(input);
-      free_command_line(&token_buffer);
+      workload_free(&jobs);
       exit(-1);
     }
     else if (child_process == 0) {
@@ -55,16 +48,12 @@ int main(int argc, char const *argv[]) {
         // handle errors
         printf("execvp() failed for '%s'\n", args[0]);
       };
-      free(input);
-      free_command_line(&token_buffer);
+      workload_free(&jobs);
       exit(-1); // will not be reached if image swap is successful
     }
-    
-    free_command_line(&token_buffer); 
 
   }
-  // free_command_line(&token_buffer);
-  free(input);
+  workload_free(&jobs);
 
   // once all processes are running, wait() for all processes to stop
   while(wait(NULL) > 0);
@@ -5,15 +5,15 @@
 #include<unistd.h> // fork, execvp
 #include<sys/types.h>
 #include<sys/wait.h>
-#include<signal.h> // sigwait, sigprocmask
-#include"string_parser.h"
+#include<signal.h> // kill
+#include"command_parser.h"
+#include"launch_barrier.h"
 
 
 // Signatures
 
 void usage();
 void print_command_line(command_line*);
-int count_lines(const char* file);
 
 
 int main(int argc, char const *argv[]) {
@@ -24,29 +24,34 @@ int main(int argc, char const *argv[]) {
     return 0;
   }
 
-  char *input = NULL;
-  size_t len = 0;
   int num_lines;
   pid_t* pid_array;
 
-  // get the number of lines in the file
-  num_lines = count_lines(argv[1]);
+  // map the file and parse every line in place
+  workload jobs;
+  if (workload_load(&jobs, argv[1]) == -1) {
+    fprintf(stderr, "can't read '%s'\n", argv[1]);
+    exit(-1);
+  }
+  num_lines = jobs.num_commands;
 
   // create array to hold PIDs
   pid_array = (pid_t*)malloc(sizeof(pid_t) * num_lines);
 
-  // open file for reading
-  freopen(argv[1], "r", stdin);
+  // open the launch barrier before forking so every child shares it
+  launch_barrier barrier;
+  if (barrier_init(&barrier) == -1) {
+    fprintf(stderr, "launch barrier setup failed\n");
+    free(pid_array);
+    workload_free(&jobs);
+    exit(-1);
+  }
 
   // iterate over commands
-  int cur = 0;
-  while(getline(&input, &len, stdin) != -1) {
+  for (int cur = 0; cur < num_lines; ++cur) {
     
-    command_line token_buffer;
-    int line_num = 0;
-
-    // get the args from the current line
-    token_buffer = str_filler(input, " ");
+    // the args of the current line, already parsed
+    command_line token_buffer = jobs.commands[cur];
 
     // for each cmd, mcp must launch the separate proc to run the cmd
     pid_t child_process = fork();
@@ -57,8 +62,7 @@ int main(int argc, char const *argv[]) {
     // handle fork
     if (child_process < 0) {
       fprintf(stderr, "fork failed\n");
-      free(input);
-      free_command_line(&token_buffer);
+      workload_free(&jobs);
       free(pid_array);
       exit(-1);
     }
@@ -66,48 +70,28 @@ int main(int argc, char const *argv[]) {
       printf("I am a child process with PID: %d\n", getpid());
       char** args = token_buffer.command_list;
       
-      // suspend execution of the child process
-      int how = SIG_BLOCK;
-      sigset_t set;
-      int sig;
-      
-      // initialize sigset and add SIGUSR1
-      sigemptyset(&set);
-      sigaddset(&set, SIGUSR1);
-      sigprocmask(how, &set, NULL);
-
-      // tell child process to wait for SIGUSR1
-      printf("PID %d waiting for SIGUSR1\n", getpid());
-      sigwait(&set, &sig);
-      printf("PID %d received SIGUSR1\n", getpid());
+      // suspend execution of the child process until every child is ready
+      printf("PID %d waiting at launch barrier\n", getpid());
+      barrier_child_wait(&barrier);
+      printf("PID %d released\n", getpid());
 
       // try to swap image, handle errors
       if (execvp(args[0], args) < 0) {
         printf("execvp() failed for '%s'\n", args[0]);
-        free(input);
-        free_command_line(&token_buffer);
+        workload_free(&jobs);
         free(pid_array);
         exit(-1);
       };
       exit(0);
     }
-    ++cur;
-    free_command_line(&token_buffer); 
   }
 
-  // free_command_line(&token_buffer);
-  free(input);
+  workload_free(&jobs);
   
-  // Delay and report for debugging
-  int delay = 3;
-  printf("%d second delay\n", delay);
-  sleep(delay);
-
-  // Send SIGUSR1 to each child process to execute workload
-  for(int i=0; i < num_lines; ++i) {
-    printf("Starting child process %d PID: %d\n",i ,pid_array[i]);
-    kill(pid_array[i], SIGUSR1);
-  }
+  // Wait until every child is ready to exec, then start them all at once
+  int ready = barrier_wait_ready(&barrier, num_lines);
+  printf("%d of %d processes ready, starting\n", ready, num_lines);
+  barrier_release(&barrier);
 
   // Send SIGSTOP to each child process
   for(int i=0; i < num_lines; ++i) {
@@ -142,23 +126,3 @@ void print_command_line(command_line* cmd){
     printf("arg %d: %s\n", j, cmd->command_list[j]);
   }
 }
-
-int count_lines(const char* file) {
-  int count = 0;
-  char* input = NULL;
-  size_t len;
-  
-  // Open file in argument
-  freopen(file, "r", stdin);
-
-  // Iterate through lines
-  while (getline(&input, &len, stdin) != -1) {
-    ++count;
-  }
-  
-  // getline mallocs input, so free it
-  free(input);
-
-  return count;
-}
-
@@ -8,8 +8,12 @@
 #include<unistd.h> // fork, execvp
 #include<sys/types.h>
 #include<sys/wait.h>
-#include<signal.h> // sigwait, sigprocmask
-#include"string_parser.h"
+#include<signal.h> // sigaction
+#include<time.h> // timer_create, timer_settime
+#include<getopt.h> // getopt_long
+#include<string.h>
+#include"command_parser.h"
+#include"launch_barrier.h"
 
 
 // Signatures
@@ -20,16 +24,16 @@ void usage(const char* cmd_name);
 // Prints the contents of 'cmd', used for debugging
 void print_command_line(command_line* cmd);
 
-// Counts the number of lines in file 'filename'
-int count_lines(const char* filename);
-
 // Schedules the next process in 'pid_array' from current index 'cur'
 int schedule_next_proc(pid_t** pid_array, int* cur);
 
 // Sets the global flag 'alarm_trigged' to 1
 void handle_alarm(int signum);
 
-// Prepares child process to execute workload in 'token_buffer' after receiving SIGUSR1
+// Starts a new quantum of 'quantum_us' microseconds on 'timer'
+void arm_quantum(timer_t timer, long quantum_us);
+
+// Prepares child process to execute workload in 'token_buffer' once the launch barrier is released
 int init_child_process(pid_t child_process, command_line token_buffer);
 
 
@@ -38,54 +42,68 @@ int init_child_process(pid_t child_process, command_line token_buffer);
 // Used by alarm handler
 volatile sig_atomic_t alarm_triggered = 0;
 
+// Shared by the children and the parent to start the workloads together
+launch_barrier barrier;
+
 
 int main(int argc, char const *argv[]) {
 
+  // Options
+  long quantum_us = 1000000;              // length of each time slice in microseconds
+  static struct option long_options[] = {
+    {"quantum", required_argument, NULL, 'q'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+
+  while ((opt = getopt_long(argc, (char* const*)argv, "q:", long_options, NULL)) != -1) {
+    if (opt != 'q' || parse_quantum(optarg, &quantum_us) == -1) {
+      usage(argv[0]);
+      return 0;
+    }
+  }
+
   // handle wrong number of arguments
-  if (argc != 2) {
+  if (optind != argc - 1) {
     usage(argv[0]);
     return 0;
   }
 
   // Declarations
   int num_lines;                          // used to determine size of pid_array
-  const char *input_filename = argv[1];   // name of input file containing list of commands
+  const char *input_filename = argv[optind]; // name of input file containing list of commands
   pid_t *pid_array;                       // holds pid of each child process
-  char *input = NULL;                     // used by getline
-  size_t len = 0;                         // used by getline
-  command_line token_buffer;              // holds arguments for each command in input file
+  workload jobs;                          // every command in the input file, parsed in place
   pid_t child_process;                    // holds pid of most recently forked child process
 
-  // get the number of lines in the file
-  num_lines = count_lines(input_filename);
+  // map the file and parse every line
+  if (workload_load(&jobs, input_filename) == -1) {
+    fprintf(stderr, "can't read '%s'\n", input_filename);
+    exit(-1);
+  }
+  num_lines = jobs.num_commands;
 
   // create array to hold PIDs
   pid_array = (pid_t*)malloc(sizeof(pid_t) * num_lines);
 
-  // open file for reading
-  freopen(input_filename, "r", stdin);
+  // open the launch barrier before forking so every child shares it
+  if (barrier_init(&barrier) == -1) {
+    fprintf(stderr, "launch barrier setup failed\n");
+    exit(-1);
+  }
 
   // iterate over commands in input file
   for (int i = 0; i < num_lines; ++i) {
-    getline(&input, &len, stdin);
     child_process = fork();
     pid_array[i] = child_process;
-    token_buffer = str_filler(input, " ");
-    init_child_process(child_process, token_buffer);
-    free_command_line(&token_buffer);
+    init_child_process(child_process, jobs.commands[i]);
   }
-  free(input);
+  workload_free(&jobs);
   
-  // Delay to make sure processes are waiting for SIGUSR1
-  int delay = 1;
-  printf("%d second delay\n", delay);
-  sleep(delay);
-
-  // Send SIGUSR1 to each child process to execute workload
-  for(int i=0; i < num_lines; ++i) {
-    printf("Sending SIGUSR1 to child process %d PID: %d\n", i, pid_array[i]);
-    kill(pid_array[i], SIGUSR1);
-  }
+  // Wait until every child is ready to exec, then release them all at once
+  int ready = barrier_wait_ready(&barrier, num_lines);
+  printf("%d of %d processes ready, releasing\n", ready, num_lines);
+  barrier_release(&barrier);
 
   // Send SIGSTOP to each child process
   for(int i=0; i < num_lines; ++i) {
@@ -93,13 +111,21 @@ int main(int argc, char const *argv[]) {
     kill(pid_array[i], SIGSTOP);
   }
 
-  // Set alarm
-  int interval = 1;
+  // Set alarm. alarm() only has one second resolution, so use a POSIX
+  // timer that delivers SIGALRM after 'quantum_us' instead
+  timer_t quantum_timer;
+  struct sigevent sev = {0};
+  sev.sigev_notify = SIGEV_SIGNAL;
+  sev.sigev_signo = SIGALRM;
   signal(SIGALRM, handle_alarm);
-  alarm(interval);
-  printf("alarm set\n");
+  if (timer_create(CLOCK_MONOTONIC, &sev, &quantum_timer) == -1) {
+    perror("timer_create");
+    exit(-1);
+  }
+  arm_quantum(quantum_timer, quantum_us);
+  printf("alarm set, quantum %ld us\n", quantum_us);
   
-  int active_processes = 5;
+  int active_processes = num_lines;
   int cur_proc = 0;
   int status_ptr;
   int cur_pid;
@@ -147,7 +173,7 @@ int main(int argc, char const *argv[]) {
       printf("sending SIGCONT to %d\n", cur_pid);
       kill(cur_pid, SIGCONT);
       printf("reseting alarm\n"); 
-      alarm(interval);
+      arm_quantum(quantum_timer, quantum_us);
       alarm_triggered = 0;
     }
     // wait for alarm
@@ -159,7 +185,10 @@ int main(int argc, char const *argv[]) {
 
 void usage(const char* cmd_name) {
   // print usage text
-  printf("Usage:\n\t%s <PATH>\n\n\t<PATH>: path to input file containing commands to be scheduled\n", cmd_name);
+  printf("Usage:\n\t%s [--quantum <TIME>] <PATH>\n\n"
+         "\t<PATH>: path to input file containing commands to be scheduled\n"
+         "\t--quantum <TIME>: length of each time slice, e.g. 500us, 20ms or 1s (default 1s)\n",
+         cmd_name);
 }
 
 
@@ -172,32 +201,24 @@ void print_command_line(command_line* cmd) {
 }
 
 
-int count_lines(const char* file) {
-  int count = 0;
-  char* input = NULL;
-  size_t len;
-  
-  // Open file in argument
-  freopen(file, "r", stdin);
-
-  // Iterate through lines
-  while (getline(&input, &len, stdin) != -1) {
-    ++count;
-  }
-  
-  // getline mallocs input, so free it
-  free(input);
-
-  return count;
-}
-
-
 void handle_alarm(int signum) {
   alarm_triggered = 1;
   return;
 }
 
 
+void arm_quantum(timer_t timer, long quantum_us) {
+  // one-shot, re-armed on every context switch like alarm()
+  struct itimerspec spec = {0};
+  spec.it_value.tv_sec = quantum_us / 1000000;
+  spec.it_value.tv_nsec = (quantum_us % 1000000) * 1000;
+  if (timer_settime(timer, 0, &spec, NULL) == -1) {
+    perror("timer_settime");
+    exit(-1);
+  }
+}
+
+
 int init_child_process(pid_t child_process, command_line token_buffer) {
   // handle fork
   if (child_process < 0) {
@@ -208,20 +229,10 @@ int init_child_process(pid_t child_process, command_line token_buffer) {
     printf("I am a child process with PID: %d\n", getpid());
     char** args = token_buffer.command_list;
     
-    // suspend execution of the child process
-    int how = SIG_BLOCK;
-    sigset_t set;
-    int sig;
-    
-    // initialize sigset and add SIGUSR1
-    sigemptyset(&set);
-    sigaddset(&set, SIGUSR1);
-    sigprocmask(how, &set, NULL);
-
-    // tell child process to wait for SIGUSR1
-    printf("PID %d waiting for SIGINT\n", getpid());
-    sigwait(&set, &sig);
-    printf("PID %d received SIGINT\n", getpid());
+    // suspend execution of the child process until every child is ready
+    printf("PID %d waiting at launch barrier\n", getpid());
+    barrier_child_wait(&barrier);
+    printf("PID %d released\n", getpid());
 
     // handle errors
     if (execvp(args[0], args) < 0) {
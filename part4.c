@@ -3,16 +3,48 @@
 
 // Imports
 
+#define _GNU_SOURCE // sched_setaffinity, CPU_SET
 #include<stdio.h>
 #include<stdlib.h>
 #include<unistd.h> // fork, execvp
 #include<sys/types.h>
 #include<sys/wait.h>
-#include<signal.h> // sigwait, sigprocmask
-#include"string_parser.h"
+#include<signal.h> // sigprocmask
+#include<sys/epoll.h> // epoll_create1, epoll_ctl, epoll_wait
+#include<sys/signalfd.h>
+#include<sys/timerfd.h>
+#include<errno.h>
+#include<fcntl.h> // open
+#include<stdint.h>
+#include<time.h> // clock_gettime
+#include<getopt.h> // getopt_long
+#include<math.h> // sqrt
+#include<sys/resource.h> // getrusage
+#include<sched.h> // sched_setaffinity, sched_getaffinity
+#include<spawn.h> // posix_spawnp
+#include<sys/pidfd.h> // pidfd_open, pidfd_send_signal
+#include"command_parser.h"
+#include"MCP.h"
+#include"launch_barrier.h"
 #include<string.h>
 
 
+// Constants
+
+// Maximum number of events handled per epoll_wait call
+#define MAX_EVENTS 16
+
+// Most lines launched per read of the input, so scheduling starts while a long workload is still being read
+#define INGEST_BATCH 256
+
+// Most processes alive at once, reading the input pauses at this many
+#define MAX_LIVE_TASKS 4096
+
+// A task off the CPU for less than this still has a warm cache and is
+// only migrated to another slot if that slot would otherwise sit idle
+#define MIGRATION_COST_US 500
+
+
 // Signatures
 
 // Displays usage if we get the wrong number of args
@@ -21,177 +53,791 @@ void usage(const char* cmd_name);
 // Prints the contents of 'cmd', used for debugging
 void print_command_line(command_line* cmd);
 
-// Counts the number of lines in file 'filename'
-int count_lines(const char* filename);
+// Gives 'slot' to the task its scheduler picks next and starts its quantum, returns the new current task
+task* schedule_next_proc(cpu_slot* slot);
 
-// Schedules the next process in 'pid_array' from current index 'cur'
-int schedule_next_proc(pid_t** pid_array, int* cur);
+// Gives every idle slot a task if any are ready
+void fill_idle_slots();
 
-// Sets the global flag 'alarm_trigged' to 1
-void handle_alarm(int signum);
+// Ends the quantum of the task running on 'slot' and moves on to the next one
+void handle_quantum_expired(cpu_slot* slot);
 
-// Prepares child process to execute workload in 'token_buffer' after receiving SIGUSR1
-int init_child_process(pid_t child_process, command_line token_buffer);
+// Queues 't' on the run queue of 'slot'
+void enqueue_task(cpu_slot* slot, task* t);
 
-// Shows status of processes
-void report(pid_t *pid_array, int num_processes);
+// Returns the slot a new task starts on, spreading tasks evenly over the slots they may run on
+cpu_slot* slot_for_new_task(task* t);
+
+// Returns the slot with the most ready tasks
+cpu_slot* busiest_slot();
+
+// Takes a task off the busiest slot's run queue for 'slot', returns it or NULL
+task* steal_task(cpu_slot* slot, long long min_idle_us);
+
+// Pulls a cold task to 'slot' if another slot has at least two more ready tasks
+void balance_slot(cpu_slot* slot);
+
+// Charges 'current' for the CPU time and I/O it used during its slice
+void account_current(scheduler* sched, task* current);
+
+// Samples 't' through netlink or /proc, returns -1 if the process is gone
+int sample_task(task* t, proc_sample* out);
+
+// Handles a fork, exec or exit event from netlink accounting, 'ctx' is the task table
+void handle_acct_event(acct_event* ev, void* ctx);
+
+// Stops the task running on 'slot' and puts it back on the slot's run queue
+void preempt_current(cpu_slot* slot);
+
+// Stops 't' by freezing its cgroup, or with SIGSTOP if it has none
+void stop_task(task* t);
+
+// Lets a stopped 't' run again
+void resume_task(task* t);
+
+// Reaps every terminated child, idle slots are left for fill_idle_slots
+void reap_children(task_table* tasks);
+
+// Reaps 't' once its pidfd reports that it exited
+void reap_task(task_table* tasks, task* t);
+
+// Prints how child 'pid' ended and drops its task from the slots, queues and table
+void retire_child(task_table* tasks, pid_t pid, int status);
+
+// Opens a pidfd for 't' and watches it for the exit, falls back to SIGCHLD if it can't
+void track_task(task* t);
+
+// Stops watching 't' and closes its pidfd
+void untrack_task(task* t);
+
+// Sends 'sig' to 't' through its pidfd, with kill() if it has none
+void signal_task(task* t, int sig);
+
+// Creates 'num_cores' execution slots, pinned to distinct CPUs if 'pin' is set, each with its
+// own 'policy' scheduler unless 'shared' is set. Returns -1 if there is no such policy
+int setup_slots(int num_cores, int pin, int shared, const char* policy, long quantum_us);
+
+// Frees the slots and their schedulers
+void free_slots();
+
+// Returns the slot whose quantum timer is 'fd', NULL if it is none
+cpu_slot* slot_for_timer(int fd);
+
+// Creates the epoll instance watching the signalfd for 'signals' and the quantum timers
+int setup_event_loop(sigset_t* signals);
+
+// Starts a new quantum of 'quantum_us' microseconds on the quantum timer of 'slot'
+void arm_quantum(cpu_slot* slot, long quantum_us);
+
+// Returns the length of the next quantum of 't' on 'slot', sized by the tuner under --adaptive
+long next_quantum(cpu_slot* slot, task* t);
+
+// Starts the quantum of 't' on 'slot', with a probe ahead of it under --io-probe
+void start_quantum(cpu_slot* slot, task* t);
+
+// Sets the timer of 'slot' for the next --io-probe, or for the deadline if that comes first
+void arm_probe(cpu_slot* slot);
+
+// Looks at the task on 'slot' mid-quantum and parks it if it's asleep
+void handle_probe(cpu_slot* slot);
 
-// Returns stat state
-void get_stat_state(pid_t pid, char* state);
+// Samples the state of 't' for --io-probe, returns 1 if it is asleep and made no CPU progress
+// since the last probe, 0 if it's runnable and -1 if it's gone
+int probe_asleep(task* t);
 
-// Returns stat user time
-void get_stat_utime(pid_t pid, double* utime);
+// Takes the sleeping task off 'slot' without stopping it and watches it until it's runnable
+void park_task(cpu_slot* slot);
 
-// Returns stat system time
-void get_stat_stime(pid_t pid, double* stime);
+// Stops and requeues, with a boost, every parked task that became runnable
+void wake_parked();
 
-// Returns stat process name
-void get_stat_name(pid_t pid, char* buffer);
+// Parses "<MIN>,<MAX>" quantum bounds, returns -1 if either is invalid or MIN > MAX
+int parse_quantum_range(const char* str, long* min_us, long* max_us);
 
-// Returns io bytes read
-int get_io_rchar(pid_t pid, unsigned long* read_bytes);
+// Stops the quantum timer of an idle 'slot'
+void disarm_quantum(cpu_slot* slot);
 
-// returns io bytes written
-int get_io_wchar(pid_t pid, unsigned long* write_bytes);
+// Records how late the context switch on 'slot' happened relative to its quantum deadline
+void record_switch_jitter(cpu_slot* slot);
+
+// Prints the min/mean/max/stddev of the recorded switch jitter
+void print_jitter_report();
+
+// Answers a control socket request, 'ctx' is the task table. Returns a malloc'd reply of '*len' bytes
+char* serve_request(const char* request, size_t* len, void* ctx);
+
+// Queues the workload line 'line' to launch ahead of the input and launches it if there is room
+void request_add(FILE* out, task_table* tasks, const char* line);
+
+// Applies kill, suspend, resume, weight, quantum or prio to the job named in 'args'
+void request_job(FILE* out, task_table* tasks, const char* command, const char* args);
+
+// Stops taking new jobs, the MCP exits once the live ones finish
+void request_drain(FILE* out, task_table* tasks);
+
+// Takes the task holding a slot or waiting in a run queue out of the rotation
+void suspend_task(task* t);
+
+// Writes the state of every live job and the totals as JSON
+void write_status_json(FILE* out, task_table* tasks);
+
+// Writes the same as write_status_json in the Prometheus text format
+void write_status_prometheus(FILE* out, task_table* tasks);
+
+// Returns how long 't' has waited ready so far, counting the current wait if it is ready now
+long long task_wait_us(task* t, long long now);
+
+// Writes makespan, turnaround, response time, context switches and the MCP's own CPU
+// time to 'path' as a JSON object, returns -1 if it can't be written
+int write_metrics(task_table* tasks, const char* path, long quantum_us);
+
+// Returns the 'p'-th percentile of the 'n' sorted 'values', by nearest rank
+double percentile(double* values, int n, double p);
+
+// qsort comparator for doubles
+int compare_doubles(const void* a, const void* b);
+
+// Gets the next job from the compiled workload or the input lines, returns 1, 0 if none has arrived yet or -1 at the end
+int next_job(command_line* cmd, job_hints* hints);
+
+// Launches up to INGEST_BATCH jobs from the lines that have arrived, returns how many were started
+int ingest_jobs(task_table* tasks);
+
+// Watches the input for new lines only while it is open and there is room for more tasks
+void update_input_watch(task_table* tasks);
+
+// Prepares child process to execute workload in 'token_buffer' once the launch barrier is released
+int init_child_process(pid_t child_process, command_line token_buffer);
+
+// Starts the workload in 'token_buffer' with posix_spawnp and stops it, returns its pid or -1
+pid_t spawn_child_process(command_line token_buffer);
+
+// Shows status of processes
+void report(task_table* tasks);
 
 
 // Globals
 
-// Used by alarm handler
-volatile sig_atomic_t alarm_triggered = 0;
+// Signal mask to restore in child processes before execvp
+sigset_t child_sigmask;
+
+// Event loop file descriptors, each slot has its own quantum timer
+int epoll_fd = -1;
+int signal_fd = -1;
+
+// Signals read from the signalfd. SIGCHLD is always blocked but only read
+// while some child has no pidfd to report its exit
+sigset_t watched_signals;
+
+// Set when the kernel has pidfds. A pidfd can't be recycled like a pid,
+// and becomes readable when its process exits, so exits come through
+// epoll one child at a time instead of SIGCHLD and a waitpid sweep
+int use_pidfd = 0;
+task** pidfd_tasks = NULL;                // indexed by pidfd
+int pidfd_table_size = 0;
+
+// Execution slots, one per core requested with --cores
+cpu_slot* slots = NULL;
+int num_slots = 0;
+
+// Per-slot run queues, or a single one shared by every slot
+scheduler* schedulers = NULL;
+int num_schedulers = 0;
+
+// Shared by the children and the parent to start the workloads together
+launch_barrier barrier;
+
+// Workload lines, launched as they arrive. A regular file can't be
+// watched by epoll and is read whenever there is room instead
+line_reader input;
+int input_pollable = 0;                   // input is a pipe, FIFO or terminal
+int input_watched = 0;                    // input is in the epoll set
+int input_backlog = 1;                    // the last read stopped with lines left to launch
+
+// Set when the input is a compiled workload, jobs are taken from it in order
+compiled_workload compiled;
+int use_compiled = 0;
+int next_compiled = 0;
+
+// Argument vectors of the batch being launched, reused batch after batch
+arena job_args;
+
+// Set by --launcher spawn, see spawn_child_process
+int use_spawn = 0;
+long long launch_us = 0;                  // time spent starting children
+
+// Set by --control cgroup when a cgroup v2 subtree can be made, jobs
+// whose own cgroup couldn't be made still get signals
+cgroup_ctl cgroups = {"", -1, 0, 0};
+int use_cgroup = 0;
+int cpu_max_percent = 0;                  // --cpu-max, 0 for no cap
+
+// Set by --accounting netlink when the kernel allows it
+netlink_acct netlink = {-1, -1, -1, 0, 0};
+int use_netlink = 0;
+
+// Counted at dispatch, a migration is a task resuming on a different slot
+unsigned long total_dispatches = 0;
+unsigned long total_migrations = 0;
+
+// Retired tasks are reused, what outlives them: totals for status
+// requests, and under --metrics one record per finished job
+double finished_cpu = 0;
+unsigned long long finished_io = 0;
+int keep_records = 0;
+task_record* records = NULL;
+int num_records = 0;
+int records_cap = 0;
+
+// Set by --socket, answers status and control requests from the event loop
+control_server control_socket = {-1};
+long long started_us = 0;
+
+// Lines submitted with "add" on the control socket, launched ahead of the input
+char** submitted = NULL;
+int num_submitted = 0;
+int submitted_head = 0;                   // next line to launch
+int submitted_cap = 0;
+
+// Set by --serve, keeps running with nothing left to do until a "drain" request
+int serving = 0;
+int draining = 0;
+
+// Set by --trace, events go to the trace instead of a report table every quantum
+int tracing = 0;
+
+// Set by --adaptive, sizes each quantum from measured switch costs and CPU bursts
+int adaptive = 0;
+quantum_tuner tuner;
+
+// Set by --io-probe. A job asleep on I/O holds its slot for nothing, so
+// the running task's state is sampled every 'io_probe_us' and one that
+// sleeps is parked: it leaves the slot but isn't stopped, so its I/O and
+// its wakeup carry on, and the next probe that finds it runnable stops
+// it and requeues it ahead of the others
+long io_probe_us = 0;
+run_queue parked;
+int park_timer_fd = -1;                   // probes parked tasks while there are any
+unsigned long total_parks = 0;
+unsigned long total_wakes = 0;
+
+// Set by --jitter, measures intended vs. actual context switch times
+int measure_jitter = 0;
+struct {
+  long samples;
+  double min_us;
+  double max_us;
+  double total_us;
+  double total_sq_us;
+} jitter;
 
 
 int main(int argc, char const *argv[]) {
 
-  // handle wrong number of arguments
-  if (argc != 2) {
+  // Options
+  long quantum_us = 1000000;              // length of each time slice in microseconds
+  const char* policy = "rr";              // scheduling policy
+  int num_cores = 1;                      // number of processes running at once
+  int pin = 0;                            // pin slots to CPUs, set by --cores
+  int shared = 0;                         // one run queue for all slots instead of one each
+  const char* accounting = "proc";        // where CPU and I/O counters come from
+  const char* control = "signal";         // how jobs are stopped and resumed
+  const char* metrics_path = NULL;        // where to write the run's metrics as JSON
+  const char* trace_path = NULL;          // where to write the binary event trace
+  const char* socket_path = NULL;         // where to answer status requests
+  const char* compile_path = NULL;        // workload to compile instead of running
+  const char* output_path = NULL;         // where to write the compiled workload
+  double overhead_pct = 0;                // --adaptive target context switch overhead
+  long min_quantum_us = 1000;             // --quantum-range bounds under --adaptive
+  long max_quantum_us = 0;                // 0 for ten times the base quantum
+  static struct option long_options[] = {
+    {"quantum", required_argument, NULL, 'q'},
+    {"jitter",  no_argument,       NULL, 'j'},
+    {"policy",  required_argument, NULL, 'p'},
+    {"cores",   required_argument, NULL, 'c'},
+    {"shared-queue", no_argument,  NULL, 's'},
+    {"accounting", required_argument, NULL, 'a'},
+    {"launcher", required_argument, NULL, 'l'},
+    {"compile", required_argument, NULL, 'C'},
+    {"output", required_argument, NULL, 'o'},
+    {"control", required_argument, NULL, 'f'},
+    {"cpu-max", required_argument, NULL, 'm'},
+    {"metrics", required_argument, NULL, 'M'},
+    {"trace", required_argument, NULL, 'T'},
+    {"socket", required_argument, NULL, 'U'},
+    {"serve", no_argument, NULL, 'S'},
+    {"adaptive", required_argument, NULL, 'A'},
+    {"quantum-range", required_argument, NULL, 'R'},
+    {"io-probe", required_argument, NULL, 'P'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+
+  while ((opt = getopt_long(argc, (char* const*)argv, "q:jp:c:sa:l:C:o:f:m:M:T:U:SA:R:P:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'q':
+        if (parse_quantum(optarg, &quantum_us) == -1) {
+          fprintf(stderr, "invalid quantum '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 'j':
+        measure_jitter = 1;
+        break;
+      case 'p':
+        policy = optarg;
+        break;
+      case 'c':
+        num_cores = atoi(optarg);
+        pin = 1;
+        if (num_cores < 1) {
+          fprintf(stderr, "invalid number of cores '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 's':
+        shared = 1;
+        break;
+      case 'a':
+        accounting = optarg;
+        if (strcmp(accounting, "proc") != 0 && strcmp(accounting, "netlink") != 0) {
+          fprintf(stderr, "unknown accounting '%s'\n", accounting);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 'l':
+        if (strcmp(optarg, "fork") != 0 && strcmp(optarg, "spawn") != 0) {
+          fprintf(stderr, "unknown launcher '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        use_spawn = strcmp(optarg, "spawn") == 0;
+        break;
+      case 'C':
+        compile_path = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'f':
+        control = optarg;
+        if (strcmp(control, "signal") != 0 && strcmp(control, "cgroup") != 0) {
+          fprintf(stderr, "unknown control '%s'\n", control);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 'M':
+        metrics_path = optarg;
+        break;
+      case 'T':
+        trace_path = optarg;
+        break;
+      case 'U':
+        socket_path = optarg;
+        break;
+      case 'S':
+        serving = 1;
+        break;
+      case 'A':
+        adaptive = 1;
+        overhead_pct = strtod(optarg, NULL);
+        if (overhead_pct <= 0 || overhead_pct >= 100) {
+          fprintf(stderr, "invalid overhead target '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 'R':
+        if (parse_quantum_range(optarg, &min_quantum_us, &max_quantum_us) == -1) {
+          fprintf(stderr, "invalid quantum range '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 'P':
+        if (parse_quantum(optarg, &io_probe_us) == -1) {
+          fprintf(stderr, "invalid probe interval '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      case 'm':
+        cpu_max_percent = atoi(optarg);
+        if (cpu_max_percent < 1) {
+          fprintf(stderr, "invalid CPU cap '%s'\n", optarg);
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 0;
+    }
+  }
+
+  // compile the workload and exit without running anything
+  if (compile_path != NULL) {
+    if (output_path == NULL || optind != argc) {
+      usage(argv[0]);
+      return 0;
+    }
+    workload jobs;
+    if (workload_load(&jobs, compile_path) == -1) {
+      fprintf(stderr, "can't read '%s'\n", compile_path);
+      return 0;
+    }
+    if (workload_compile(&jobs, output_path) == -1) {
+      fprintf(stderr, "can't write '%s'\n", output_path);
+      workload_free(&jobs);
+      return 0;
+    }
+    printf("compiled %d jobs from %s into %s\n", jobs.num_commands, compile_path, output_path);
+    workload_free(&jobs);
+    return 0;
+  }
+
+  // handle wrong number of arguments, jobs only reach --serve through the socket
+  if (optind != argc - 1 || (serving && socket_path == NULL)) {
     usage(argv[0]);
     return 0;
   }
 
+  keep_records = metrics_path != NULL;
+
   // Declarations
-  int num_lines;                          // used to determine size of pid_array
-  const char *input_filename = argv[1];   // name of input file containing list of commands
-  pid_t *pid_array;                       // holds pid of each child process
-  char *input = NULL;                     // used by getline
-  size_t len = 0;                         // used by getline
-  command_line token_buffer;              // holds arguments for each command in input file
-  pid_t child_process;                    // holds pid of most recently forked child process
-
-  // get the number of lines in the file
-  num_lines = count_lines(input_filename);
-
-  // create array to hold PIDs
-  pid_array = (pid_t*)malloc(sizeof(pid_t) * num_lines);
-
-  // open file for reading
-  freopen(input_filename, "r", stdin);
-
-  // iterate over commands in input file
-  for (int i = 0; i < num_lines; ++i) {
-    getline(&input, &len, stdin);
-    child_process = fork();
-    pid_array[i] = child_process;
-    token_buffer = str_filler(input, " ");
-    init_child_process(child_process, token_buffer);
-    free_command_line(&token_buffer);
-  }
-  free(input);
-  
-  // Delay to make sure processes are waiting for SIGUSR1
-  int delay = 1;
-  printf("%d second delay\n", delay);
-  sleep(delay);
-
-  // Send SIGUSR1 to each child process to execute workload
-  for(int i=0; i < num_lines; ++i) {
-    printf("Sending SIGUSR1 to child process %d PID: %d\n", i, pid_array[i]);
-    kill(pid_array[i], SIGUSR1);
-  }
-
-  // Send SIGSTOP to each child process
-  for(int i=0; i < num_lines; ++i) {
-    printf("Sending SIGSTOP to  process %d PID: %d\n", i, pid_array[i]);
-    kill(pid_array[i], SIGSTOP);
-  }
-
-  // Set alarm
-  int interval = 1;
-  signal(SIGALRM, handle_alarm);
-  alarm(interval);
-  printf("alarm set\n");
-  
-  int active_processes = 5;
-  int cur_proc = 0;
-  int status_ptr;
-  int cur_pid;
-  int wait_ret;
-
-  while(active_processes) {
-    if (alarm_triggered) {
-      report(pid_array, num_lines);
-      // printf("alarm received\n");
-      cur_pid = pid_array[cur_proc];
-      // don't check already termiated processes
-      if (cur_pid > 0) {
-        wait_ret = waitpid(cur_pid, &status_ptr, WNOHANG);
-        // something went wrong
-        if (wait_ret == -1) {
-          printf("waitpid error\n");
-          exit(-1);
-        }
-        // status changed
-        else if (wait_ret > 0) {
-          // process terminated
-          if (WIFEXITED(status_ptr)) {
-            int exit_code = WEXITSTATUS(status_ptr);
-            printf("PID %d exited with status %d\n", cur_pid, exit_code);
-            pid_array[cur_proc] = -1;
-            --active_processes;
-            // if we are done, exit
-            if (active_processes == 0) {
-              printf("all processes terminated, exiting\n");
-              free(pid_array);
-              exit(0);
+  const char *input_filename = argv[optind]; // file, FIFO or "-" for stdin listing commands to schedule
+  task_table tasks;                       // holds a task for each child process
+
+  // set up the execution slots and their scheduling policy
+  if (setup_slots(num_cores, pin, shared, policy, quantum_us) == -1) {
+    fprintf(stderr, "unknown policy '%s'\n", policy);
+    usage(argv[0]);
+    return 0;
+  }
+  if (adaptive) {
+    if (max_quantum_us == 0) {
+      max_quantum_us = quantum_us * 10 > min_quantum_us ? quantum_us * 10 : min_quantum_us;
+    }
+    tuner_init(&tuner, overhead_pct, min_quantum_us, max_quantum_us);
+    printf("adaptive quantum, %.2f%% overhead target, %ld us to %ld us\n",
+      overhead_pct, min_quantum_us, max_quantum_us);
+  }
+
+  // subscribe before forking so no exit is missed
+  if (strcmp(accounting, "netlink") == 0) {
+    if (netlink_acct_open(&netlink) == 0) {
+      use_netlink = 1;
+      printf("netlink accounting enabled%s\n", netlink.connector_fd == -1 ? " (no proc connector)" : "");
+    }
+    else {
+      printf("netlink accounting not permitted, falling back to /proc\n");
+    }
+  }
+
+  // one cgroup per job, made before its process so nothing escapes
+  if (strcmp(control, "cgroup") == 0) {
+    if (cgroup_ctl_open(&cgroups) == 0) {
+      use_cgroup = 1;
+      printf("cgroup job control in %s%s\n", cgroups.path,
+        cgroups.has_cpu ? "" : " (no cpu controller, @weight and --cpu-max are not enforced by the kernel)");
+    }
+    else {
+      printf("cgroup v2 not available, falling back to signals\n");
+    }
+  }
+  if (cpu_max_percent > 0 && !cgroups.has_cpu) {
+    printf("--cpu-max needs --control cgroup with the cpu controller, ignoring it\n");
+  }
+
+  // the flusher thread starts before any child, which only execs
+  if (trace_path != NULL) {
+    if (trace_open(trace_path) == -1) {
+      fprintf(stderr, "can't trace to '%s'\n", trace_path);
+      return 0;
+    }
+    tracing = 1;
+  }
+
+  // a compiled workload is mapped and launched without parsing
+  int compiled_status = strcmp(input_filename, "-") == 0 ? 0 : compiled_open(&compiled, input_filename);
+  if (compiled_status == -1) {
+    fprintf(stderr, "'%s' is a damaged compiled workload\n", input_filename);
+    return 0;
+  }
+  if (compiled_status == 1) {
+    use_compiled = 1;
+    input.fd = -1;
+    printf("running compiled workload, %d jobs\n", compiled.num_jobs);
+  }
+  // otherwise open the input, lines are launched as they are read
+  else if (line_reader_open(&input, input_filename) == -1) {
+    fprintf(stderr, "can't open '%s'\n", input_filename);
+    return 0;
+  }
+  arena_init(&job_args, sizeof(char*) * 4096);
+
+  // Block the signals the event loop listens for before forking so none
+  // are lost; children restore the original mask before execvp
+  sigset_t loop_signals;
+  sigemptyset(&loop_signals);
+  sigaddset(&loop_signals, SIGCHLD);
+  sigaddset(&loop_signals, SIGINT);
+  sigaddset(&loop_signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &loop_signals, &child_sigmask);
+
+  // create table to hold tasks
+  task_table_init(&tasks);
+
+  // Set up the event loop: the MCP sleeps in epoll_wait until the quantum
+  // timer fires or a signal arrives, instead of spinning on a flag
+  int probe = pidfd_open(getpid(), 0);
+  if (probe != -1) {
+    use_pidfd = 1;
+    close(probe);
+  }
+  watched_signals = loop_signals;
+  if (use_pidfd) {
+    sigdelset(&watched_signals, SIGCHLD);
+  }
+  epoll_fd = setup_event_loop(&watched_signals);
+  if (io_probe_us > 0) {
+    rq_init(&parked);
+    park_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (park_timer_fd == -1) {
+      perror("timerfd_create");
+      exit(-1);
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = park_timer_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, park_timer_fd, &ev);
+    printf("probing dispatched jobs every %ld us for I/O sleeps\n", io_probe_us);
+  }
+  printf("event loop ready, policy %s, quantum %ld us, %d core(s), %s run queue, exits through %s\n",
+    schedulers[0].name, quantum_us, num_slots, num_schedulers > 1 ? "per-core" : "shared",
+    use_pidfd ? "pidfds" : "SIGCHLD");
+
+  // answered between events, a request never waits for more than one
+  if (socket_path != NULL) {
+    if (control_open(&control_socket, socket_path, epoll_fd) == -1) {
+      fprintf(stderr, "can't listen on '%s'\n", socket_path);
+      return 0;
+    }
+    printf("answering status requests on %s\n", socket_path);
+  }
+  started_us = now_us();
+
+  struct epoll_event events[MAX_EVENTS];
+  long long last_report_us = 0;
+
+  // launch the first lines and give them their quantum right away
+  ingest_jobs(&tasks);
+  update_input_watch(&tasks);
+  fill_idle_slots();
+
+  while(tasks.num_live > 0 || !input.done || submitted_head < num_submitted || (serving && !draining)) {
+    // don't block while there are lines epoll won't tell us about
+    int more_input = tasks.num_live < MAX_LIVE_TASKS &&
+      ((!input.done && (!input_pollable || input_backlog)) || submitted_head < num_submitted);
+    int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, more_input ? 0 : -1);
+    if (num_events == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      exit(-1);
+    }
+
+    for (int i = 0; i < num_events; ++i) {
+      int fd = events[i].data.fd;
+      cpu_slot* slot;
+
+      // SIGCHLD, SIGINT or SIGTERM delivered through the signalfd
+      if (fd == signal_fd) {
+        struct signalfd_siginfo info;
+        while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+          if (info.ssi_signo == SIGCHLD) {
+            // SIGCHLD is not queued, one delivery can stand for several
+            // exits. Don't let the rest of a quantum go to waste if a
+            // running process was one of them
+            reap_children(&tasks);
+            update_input_watch(&tasks);
+            fill_idle_slots();
+          }
+          else {
+            printf("received signal %d, terminating child processes\n", info.ssi_signo);
+            while (tasks.live_head != NULL) {
+              task* t = tasks.live_head;
+              if (t->cgroup.dir_fd != -1) {
+                cgroup_kill(&t->cgroup);
+              }
+              signal_task(t, SIGKILL);
+              waitpid(t->pid, NULL, 0);
+              untrack_task(t);
+              close_proc_files(&t->proc);
+              cgroup_remove_job(&cgroups, t->index, &t->cgroup);
+              task_table_remove(&tasks, t);
             }
+            // drops the jobs submitted over the socket while the table is still valid
+            request_drain(NULL, &tasks);
+            free_task_table(&tasks);
+            free_slots();
+            cgroup_ctl_close(&cgroups);
+            free(pidfd_tasks);
+            trace_close();
+            control_close(&control_socket, epoll_fd);
+            exit(-1);
           }
         }
-        // process still running
-        else {
-          // printf("sending SIGSTOP to %d\n", cur_pid);
-          // kill(cur_pid, SIGSTOP);
-        }
       }
+      // new lines, or the last writer went away
+      else if (fd == input.fd) {
+        ingest_jobs(&tasks);
+        update_input_watch(&tasks);
+        fill_idle_slots();
+      }
+      // exit totals or fork/exec events from netlink accounting
+      else if (fd == netlink.exit_fd || fd == netlink.connector_fd) {
+        netlink_drain(&netlink, fd, handle_acct_event, &tasks);
+      }
+      // a status request, or more room for a reply
+      else if (control_owns(&control_socket, fd)) {
+        control_handle(&control_socket, epoll_fd, fd, events[i].events, serve_request, &tasks);
+      }
+      // time to see whether any parked task can run again
+      else if (fd == park_timer_fd) {
+        uint64_t expirations;
+        read(park_timer_fd, &expirations, sizeof(expirations));
+        wake_parked();
+      }
+      // quantum expired on one of the slots, move on to the next process
+      else if ((slot = slot_for_timer(fd)) != NULL) {
+        // re-armed by an earlier event in this batch, the expiration is gone
+        uint64_t expirations;
+        if (read(slot->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+          continue;
+        }
 
-      do {
-        cur_proc = (cur_proc + 1) % num_lines;
-      } while (pid_array[cur_proc] == -1);
-
-      // schedule next process
-      // printf("sending SIGSTOP to %d\n", cur_pid);
-      kill(cur_pid, SIGSTOP);
-      cur_pid = pid_array[cur_proc];
-      // printf("sending SIGCONT to %d\n", cur_pid);
-      kill(cur_pid, SIGCONT);
+        // only a probe, the quantum isn't over
+        if (slot->probing) {
+          handle_probe(slot);
+          continue;
+        }
 
-      // reset alarm
-      // printf("reseting alarm\n"); 
-      alarm(interval);
-      alarm_triggered = 0;
+        // one report per base quantum no matter how many slots there are,
+        // a trace has the samples already
+        if (!tracing && now_us() - last_report_us >= quantum_us) {
+          report(&tasks);
+          last_report_us = now_us();
+        }
+        handle_quantum_expired(slot);
+      }
+      // a child exited, nothing to do if an earlier event in this batch
+      // reaped it, the timers share the fd range so they're matched first
+      else if (fd < pidfd_table_size) {
+        if (pidfd_tasks[fd] != NULL) {
+          reap_task(&tasks, pidfd_tasks[fd]);
+          update_input_watch(&tasks);
+          fill_idle_slots();
+        }
+      }
+      else {
+        fprintf(stderr, "event on unknown fd %d\n", fd);
+        exit(-1);
+      }
+    }
 
-      // report(pid_array, num_lines);
+    if (more_input) {
+      ingest_jobs(&tasks);
+      update_input_watch(&tasks);
+      fill_idle_slots();
     }
-    // wait for alarm
   }
 
-  free(pid_array);
-  exit(-1); // We somehow broke the loop without exiting. This should not happen.
+  printf("all processes terminated, exiting\n");
+  printf("launched %d processes with %s in %.3f ms, %.0f per second\n",
+    tasks.count,
+    use_spawn ? "posix_spawn" : "fork",
+    launch_us / 1000.0,
+    launch_us > 0 ? tasks.count * 1e6 / launch_us : 0.0
+    );
+  printf("%lu dispatches, %lu migrations between slots\n", total_dispatches, total_migrations);
+  if (io_probe_us > 0) {
+    printf("%lu dispatches handed on asleep, %lu woke and were requeued ahead\n", total_parks, total_wakes);
+  }
+  if (measure_jitter) {
+    print_jitter_report();
+  }
+  if (adaptive) {
+    printf("adaptive quantum: switch %.1f us + %.1f us of MCP CPU, floor %ld us, mean quantum %.3f ms over %lu slices\n",
+      tuner.switch_us, tuner.mcp_cpu_us, tuner.floor_us,
+      tuner.slices > 0 ? tuner.total_quantum_us / 1e3 / tuner.slices : 0.0, tuner.slices);
+  }
+  if (metrics_path != NULL && write_metrics(&tasks, metrics_path, quantum_us) == -1) {
+    fprintf(stderr, "can't write metrics to '%s'\n", metrics_path);
+  }
+  if (tracing) {
+    printf("trace written to %s, %llu events dropped\n", trace_path, trace_close());
+  }
+  free_slots();
+  line_reader_close(&input);
+  compiled_close(&compiled);
+  arena_free(&job_args);
+  netlink_acct_close(&netlink);
+  cgroup_ctl_close(&cgroups);
+  free(pidfd_tasks);
+  control_close(&control_socket, epoll_fd);
+  free(submitted);
+  if (park_timer_fd != -1) {
+    close(park_timer_fd);
+  }
+  close(signal_fd);
+  close(epoll_fd);
+  free_task_table(&tasks);
+  free(records);
+  exit(0);
 }
 
 
 void usage(const char* cmd_name) {
   // print usage text
-  printf("Usage:\n\t%s <PATH>\n\n\t<PATH>: path to input file containing commands to be scheduled\n", cmd_name);
+  printf("Usage:\n\t%s [--quantum <TIME>] [--policy <rr|mlfq|stride|cfs>] [--cores <N>] [--shared-queue]\n"
+         "\t\t[--accounting <proc|netlink>] [--launcher <fork|spawn>] [--control <signal|cgroup>] [--cpu-max <PERCENT>]\n"
+         "\t\t[--adaptive <PERCENT> [--quantum-range <MIN>,<MAX>]] [--io-probe <TIME>] [--jitter] [--metrics <JSON>] [--trace <FILE>] [--socket <PATH> [--serve]] <PATH>\n"
+         "\t%s --compile <PATH> -o <OUTPUT>\n\n"
+         "\t<PATH>: file or FIFO of commands to be scheduled, one per line, or - for stdin; jobs start as their lines arrive.\n"
+         "\t\tMay also be a workload compiled with --compile. A line may start with annotations:\n"
+         "\t\t@prio=N (higher runs first), @weight=N (CPU share), @quantum=TIME and @cpus=0-3,6\n"
+         "\t--quantum <TIME>: length of each time slice, e.g. 500us, 20ms or 1s (default 1s)\n"
+         "\t--adaptive <PERCENT>: size each job's quantum from its measured CPU bursts, never so short that context\n"
+         "\t\tswitches, as measured, cost more than PERCENT of the CPU. --quantum becomes the starting point\n"
+         "\t--quantum-range <MIN>,<MAX>: bounds on adaptive quanta, e.g. 2ms,5s (default 1ms to ten times --quantum)\n"
+         "\t--io-probe <TIME>: check the running job's state every TIME, e.g. 5ms. One asleep on I/O, with no CPU used since\n"
+         "\t\tthe last check, gives up its slot unstopped, and is stopped and put at the front of its queue once it is runnable again\n"
+         "\t--policy <rr|mlfq|stride|cfs>: round-robin, multi-level feedback queue where the quantum is the top level's,\n"
+         "\t\tstride scheduling by @weight within @prio classes, or completely fair scheduling by CPU used / @weight (default rr)\n"
+         "\t--cores <N>: run up to N processes at once, each pinned to its own CPU (default 1, unpinned)\n"
+         "\t--shared-queue: one run queue for all cores instead of per-core queues with work stealing\n"
+         "\t--accounting <proc|netlink>: poll /proc, or use taskstats and the proc connector where permitted (default proc)\n"
+         "\t--launcher <fork|spawn>: fork each child and hold it at a barrier, or posix_spawn it and stop it right away (default fork)\n"
+         "\t--control <signal|cgroup>: stop and resume jobs with SIGSTOP/SIGCONT, or freeze each job's own cgroup v2,\n"
+         "\t\twhich also stops its children and counts their CPU and I/O (default signal, cgroup falls back to it)\n"
+         "\t--cpu-max <PERCENT>: with --control cgroup, cap each job at PERCENT of one CPU through cpu.max\n"
+         "\t--compile <PATH> -o <OUTPUT>: parse PATH once and write it to OUTPUT as a compiled workload, which runs without parsing\n"
+         "\t--jitter: measure and report the delay between intended and actual context switches\n"
+         "\t--trace <FILE>: record spawn, dispatch, preempt, block, exit and sample events to a binary FILE,\n"
+         "\t\tread it with trace_export. Replaces the per-quantum report table\n"
+         "\t--socket <PATH>: answer a request line of 'json' or 'metrics' (Prometheus text) on a Unix socket with\n"
+         "\t\teach job's CPU time, I/O bytes, state, level, wait time and dispatches, and the totals. Also takes\n"
+         "\t\tadd <LINE>, kill|suspend|resume <JOB>, weight <JOB> <N>, quantum <JOB> <TIME>, prio <JOB> <N> and drain\n"
+         "\t--serve: with --socket, keep running once every job is done until a drain request\n"
+         "\t--metrics <JSON>: write makespan, turnaround, response time, context switches, MCP CPU time and the\n"
+         "\t\tjobs' CPU, I/O and, under netlink, delay totals to JSON\n",
+         cmd_name, cmd_name);
 }
 
 
@@ -204,237 +850,1530 @@ void print_command_line(command_line* cmd) {
 }
 
 
-int count_lines(const char* file) {
-  int count = 0;
-  char* input = NULL;
-  size_t len;
-  
-  // Open file in argument
-  freopen(file, "r", stdin);
+task* schedule_next_proc(cpu_slot* slot) {
+  // terminated processes are never queued, so the pick is always runnable
+  task* next = slot->sched->pick_next(slot->sched, slot->cpu);
 
-  // Iterate through lines
-  while (getline(&input, &len, stdin) != -1) {
-    ++count;
+  // nothing of our own to run, take work from the busiest slot no matter
+  // how warm its cache is rather than leave this CPU idle
+  if (next == NULL) {
+    next = steal_task(slot, 0);
   }
-  
-  // getline mallocs input, so free it
-  free(input);
 
-  return count;
-}
+  slot->current = next;
+  if (next == NULL) {
+    disarm_quantum(slot);
+    return NULL;
+  }
 
+  // only pay for the affinity syscall when the task changes CPU
+  if (slot->cpu >= 0 && next->last_cpu != slot->cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(slot->cpu, &set);
+    sched_setaffinity(next->pid, sizeof(set), &set);
+    next->last_cpu = slot->cpu;
+  }
 
-void handle_alarm(int signum) {
-  alarm_triggered = 1;
-  return;
+  int slot_index = slot - slots;
+  if (next->last_slot != -1 && next->last_slot != slot_index) {
+    ++total_migrations;
+  }
+  ++total_dispatches;
+  ++next->dispatches;
+  next->wait_us = task_wait_us(next, now_us());
+
+  next->state = TASK_RUNNING;
+  next->slot = slot_index;
+  next->last_slot = slot_index;
+  next->dispatched_us = now_us();
+  if (next->first_run_us == 0) {
+    next->first_run_us = next->dispatched_us;
+  }
+  trace_emit(TRACE_DISPATCH, next->pid, slot_index, 0);
+  resume_task(next);
+  if (measure_jitter) {
+    record_switch_jitter(slot);
+  }
+  start_quantum(slot, next);
+  return next;
 }
 
 
-int init_child_process(pid_t child_process, command_line token_buffer) {
-  // handle fork
-  if (child_process < 0) {
-    fprintf(stderr, "fork failed\n");
-    exit(-1);
+void fill_idle_slots() {
+  for (int i = 0; i < num_slots; ++i) {
+    if (slots[i].current == NULL) {
+      schedule_next_proc(&slots[i]);
+    }
   }
-  else if (child_process == 0) {
-    printf("I am a child process with PID: %d\n", getpid());
-    char** args = token_buffer.command_list;
-    
-    // suspend execution of the child process
-    int how = SIG_BLOCK;
-    sigset_t set;
-    int sig;
-    
-    // initialize sigset and add SIGUSR1
-    sigemptyset(&set);
-    sigaddset(&set, SIGUSR1);
-    sigprocmask(how, &set, NULL);
+}
 
-    // tell child process to wait for SIGUSR1
-    printf("PID %d waiting for SIGINT\n", getpid());
-    sigwait(&set, &sig);
-    printf("PID %d received SIGINT\n", getpid());
 
-    // handle errors
-    if (execvp(args[0], args) < 0) {
-      printf("execvp() failed for '%s'\n", args[0]);
-      exit(-1);
-    };
+void handle_quantum_expired(cpu_slot* slot) {
+  task* current = slot->current;
+  scheduler* sched = slot->sched;
+
+  // terminated processes are reaped on SIGCHLD
+  if (current != NULL) {
+    account_current(sched, current);
+    balance_slot(slot);
+    // nothing else is ready, let the current process keep the CPU
+    if (sched->nr_ready == 0) {
+      start_quantum(slot, current);
+      return;
+    }
+    // timed from here, a task that keeps its slot is no switch
+    if (adaptive) {
+      tuner_begin_switch(&tuner);
+    }
+    preempt_current(slot);
+  }
+  if (schedule_next_proc(slot) != NULL && current != NULL && adaptive) {
+    tuner_end_switch(&tuner, current->stopped_us);
   }
 }
 
-void report(pid_t *pid_array, int num_processes) {
 
-  printf("PID \t PROC NAME \t STATE \t USER TIME \t KERNEL TIME \t READ \t WRITE \n");
+void enqueue_task(cpu_slot* slot, task* t) {
+  t->queue = slot - slots;
+  slot->sched->enqueue(slot->sched, t);
+}
 
-  for (int i = 0; i < num_processes; ++i) {
-    int cur_pid = pid_array[i];
 
-    if (cur_pid == -1) {
-      // process is terminated, don't print anything
-    }
-    else {
-      int state_size = 20;
-      char state[state_size];
-      char name[128];
-      double utime;
-      double stime;
-      unsigned long read_bytes = 0;
-      unsigned long write_bytes = 0;
-  
-      get_stat_name(cur_pid, name);
-      get_stat_state(cur_pid, state);
-      get_stat_utime(cur_pid, &utime);
-      get_stat_stime(cur_pid, &stime);
-      get_io_rchar(cur_pid, &read_bytes);
-      get_io_wchar(cur_pid, &write_bytes);
-  
-      printf("%d \t %-8s \t %s \t %lf \t %lf \t %lu \t %-12lu \n",
-        cur_pid,
-        name,
-        state,
-        utime,
-        stime,
-        read_bytes,
-        write_bytes
-        );
+cpu_slot* slot_for_new_task(task* t) {
+  for (int i = 0; i < num_slots; ++i) {
+    cpu_slot* slot = &slots[(t->index + i) % num_slots];
+    if (task_allowed(t, slot->cpu)) {
+      // unpinned slots leave placement to the kernel, within the job's CPUs
+      if (slot->cpu < 0 && t->cpus != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; ++cpu) {
+          if ((t->cpus >> cpu) & 1) {
+            CPU_SET(cpu, &set);
+          }
+        }
+        sched_setaffinity(t->pid, sizeof(set), &set);
+      }
+      return slot;
     }
   }
+
+  // none of the slots is on one of its CPUs, better to run it anywhere than never
+  printf("PID %d: no slot runs on its @cpus, ignoring them\n", t->pid);
+  t->cpus = 0;
+  return &slots[t->index % num_slots];
 }
 
-void get_stat_state(pid_t pid, char* buffer) {
-  char path[128];
-  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-  FILE *fp = fopen(path, "r");
 
-  if (fp == NULL) {
-     printf("Error opening file: %s\n", path);
-     exit(-1);
+cpu_slot* busiest_slot() {
+  cpu_slot* busiest = &slots[0];
+  for (int i = 1; i < num_slots; ++i) {
+    if (slots[i].sched->nr_ready > busiest->sched->nr_ready) {
+      busiest = &slots[i];
+    }
   }
-  fscanf(fp, "%*d %*s %s", buffer);
-  fclose(fp);
+  return busiest;
 }
 
-void get_stat_utime(pid_t pid, double* output) {
-  char path[128];
-  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-  FILE *fp = fopen(path, "r");
 
-  if (fp == NULL) {
-    printf("Error opening file: %s\n", path);
-    exit(-1);
+task* steal_task(cpu_slot* slot, long long min_idle_us) {
+  // with a shared run queue there is nothing to steal from
+  cpu_slot* busiest = busiest_slot();
+  if (busiest->sched == slot->sched || busiest->sched->nr_ready == 0) {
+    return NULL;
   }
-  
-  for (int i =  0; i < 13; i++) {
-    fscanf(fp, "%*s");
+
+  task* t = busiest->sched->steal(busiest->sched, min_idle_us, slot->cpu);
+  if (t != NULL) {
+    t->queue = slot - slots;
   }
+  return t;
+}
+
 
-  unsigned long utime;
-  fscanf(fp, "%lu", &utime);
-  fclose(fp);
+void balance_slot(cpu_slot* slot) {
+  cpu_slot* busiest = busiest_slot();
+
+  // moving a task only helps if it evens out the queues
+  if (busiest->sched->nr_ready < slot->sched->nr_ready + 2) {
+    return;
+  }
 
-  long ticks_per_sec = sysconf(_SC_CLK_TCK);
-  *output = utime / (double)ticks_per_sec;
+  // only cold tasks, a warm one is better off waiting for its own CPU
+  task* t = steal_task(slot, MIGRATION_COST_US);
+  if (t != NULL) {
+    enqueue_task(slot, t);
+  }
 }
 
-void get_stat_stime(pid_t pid, double* output) {
-  char path[128];
-  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-  FILE *fp = fopen(path, "r");
 
-  if (fp == NULL) {
-    printf("Error opening file: %s\n", path);
-    exit(-1);
+void account_current(scheduler* sched, task* current) {
+  proc_sample sample;
+
+  // the process exited, SIGCHLD will take care of it
+  if (sample_task(current, &sample) == -1) {
+    return;
   }
-  
-  for (int i =  0; i < 14; i++) {
-    fscanf(fp, "%*s");
+
+  // charge the deltas since the last sample
+  long long now = now_us();
+  sched->account(sched, current,
+    sample.utime + sample.stime - current->cpu_time,
+    sample.rchar + sample.wchar - current->io_bytes,
+    now - current->dispatched_us);
+  if (adaptive) {
+    tuner_record_slice(&tuner, current, sample.utime + sample.stime - current->cpu_time, now - current->dispatched_us);
   }
 
-  unsigned long stime;
-  if (fscanf(fp, "%lu", &stime) != 1) {
-    printf("Error reading stime for pid: %d\n", pid);
-    fclose(fp);
-    exit(EXIT_FAILURE);
+  trace_emit(TRACE_SAMPLE, current->pid, current->slot, (sample.utime + sample.stime) * 1e6);
+  if (sample.state == 'S' || sample.state == 'D') {
+    trace_emit(TRACE_BLOCK, current->pid, current->slot, sample.state);
   }
-  fclose(fp);
 
-  long ticks_per_sec = sysconf(_SC_CLK_TCK);
-  *output = stime / (double)ticks_per_sec;
+  current->cpu_time = sample.utime + sample.stime;
+  current->io_bytes = sample.rchar + sample.wchar;
+  current->dispatched_us = now;
 }
 
-void get_stat_name(pid_t pid, char* buffer) {
-  char path[128];
-  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-  
-  FILE *fp = fopen(path, "r");
 
-  if (fp == NULL) {
-    printf("Error opening file: %s\n", path);
-    exit(-1);
+int sample_task(task* t, proc_sample* out) {
+  // under netlink this is the one taskstats query left, once per slice for
+  // the task that ran it: the policies charge each slice's CPU, and no
+  // event reports a live process's CPU time
+  int status = use_netlink ? netlink_sample(&netlink, t->pid, out) : sample_proc(&t->proc, out);
+
+  // the cgroup counts every process of the job, not just the one we forked
+  if (status == 0 && t->cgroup.dir_fd != -1) {
+    cgroup_sample(&t->cgroup, out);
+  }
+  return status;
+}
+
+
+void handle_acct_event(acct_event* ev, void* ctx) {
+  task_table* tasks = ctx;
+
+  switch (ev->type) {
+    case ACCT_FORK: {
+      // a workload spawning processes of its own
+      task* t = task_table_find(tasks, ev->parent);
+      if (t != NULL) {
+        ++t->forks;
+      }
+      break;
+    }
+    case ACCT_EXEC: {
+      task* t = task_table_find(tasks, ev->pid);
+      if (t != NULL) {
+        t->exec_us = now_us();
+      }
+      break;
+    }
+    case ACCT_EXIT: {
+      // every process on the system exits through here, keep our children
+      task* t = ev->parent == getpid() ? task_table_find(tasks, ev->pid) : NULL;
+      if (t != NULL) {
+        // exact lifetime totals replace the last slice's sample, a job
+        // with a cgroup counts its other processes too while it still can
+        proc_sample totals = ev->totals;
+        if (t->cgroup.dir_fd != -1) {
+          cgroup_sample(&t->cgroup, &totals);
+        }
+        t->cpu_time = totals.utime + totals.stime;
+        t->io_bytes = totals.rchar + totals.wchar;
+        t->cpu_delay_ns = ev->totals.cpu_delay_ns;
+        t->blkio_delay_ns = ev->totals.blkio_delay_ns;
+        printf("PID %d totals: user %.3f s, kernel %.3f s, read %lu, written %lu, "
+               "cpu delay %.1f ms, io delay %.1f ms\n",
+          ev->pid,
+          ev->totals.utime,
+          ev->totals.stime,
+          ev->totals.rchar,
+          ev->totals.wchar,
+          ev->totals.cpu_delay_ns / 1e6,
+          ev->totals.blkio_delay_ns / 1e6
+          );
+      }
+      break;
+    }
   }
-  
-  fscanf(fp, "%*s");
+}
+
 
-  if (fscanf(fp, "%s", buffer) != 1) {
-    printf("Error reading name for pid: %d\n", pid);
-    fclose(fp);
-    exit(EXIT_FAILURE);
+void preempt_current(cpu_slot* slot) {
+  task* current = slot->current;
+  if (current == NULL) {
+    return;
   }
+  stop_task(current);
+  trace_emit(TRACE_PREEMPT, current->pid, slot - slots, 0);
+  current->state = TASK_READY;
+  current->slot = -1;
+  current->stopped_us = now_us();
+  // stay on this slot's queue so the task keeps its CPU and cache
+  enqueue_task(slot, current);
+  slot->current = NULL;
+}
+
 
-  fclose(fp);
+void stop_task(task* t) {
+  if (t->cgroup.dir_fd != -1) {
+    cgroup_freeze(&t->cgroup, 1);
+  }
+  else {
+    signal_task(t, SIGSTOP);
+  }
 }
 
-int get_io_rchar(pid_t pid, unsigned long *read_bytes) {
-  char path[128];                                     
-  snprintf(path, sizeof(path), "/proc/%d/io", pid);
-  
-  FILE *fp = fopen(path, "r");
 
-  if (fp == NULL) {
-    // printf("Error opening file: %s\n", path);
-    return -1;
+void resume_task(task* t) {
+  if (t->cgroup.dir_fd != -1) {
+    cgroup_freeze(&t->cgroup, 0);
+  }
+  else {
+    signal_task(t, SIGCONT);
   }
+}
 
-  char label[64];
-  unsigned long value;
 
-  while (fscanf(fp, "%s %lu", label, &value) != EOF) {
-    if (strcmp(label, "rchar:") == 0) {
-      *read_bytes = value;
-      fclose(fp);
-      return 0;
+void track_task(task* t) {
+  t->pidfd = use_pidfd ? pidfd_open(t->pid, 0) : -1;
+
+  // out of fds, listen for SIGCHLD again so this child's exit isn't missed
+  if (t->pidfd == -1) {
+    if (use_pidfd && sigismember(&watched_signals, SIGCHLD) == 0) {
+      sigaddset(&watched_signals, SIGCHLD);
+      signalfd(signal_fd, &watched_signals, 0);
+    }
+    return;
+  }
+
+  // grow by doubling, pidfds are small and dense like any other fd
+  if (t->pidfd >= pidfd_table_size) {
+    int size = pidfd_table_size > 0 ? pidfd_table_size : 256;
+    while (size <= t->pidfd) {
+      size *= 2;
     }
+    task** table = realloc(pidfd_tasks, sizeof(task*) * size);
+    if (table == NULL) {
+      fprintf(stderr, "pidfd table allocation failed\n");
+      exit(-1);
+    }
+    memset(table + pidfd_table_size, 0, sizeof(task*) * (size - pidfd_table_size));
+    pidfd_tasks = table;
+    pidfd_table_size = size;
   }
+  pidfd_tasks[t->pidfd] = t;
 
-  fclose(fp);
-  // no value found
-  return -1;
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = t->pidfd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, t->pidfd, &ev);
 }
 
-int get_io_wchar(pid_t pid, unsigned long *write_bytes) {
-  char path[128];                                     
-  snprintf(path, sizeof(path), "/proc/%d/io", pid);
-  
-  FILE *fp = fopen(path, "r");
 
-  if (fp == NULL) {
-    // printf("Error opening file: %s\n", path);
-    return -1;
+void untrack_task(task* t) {
+  if (t->pidfd == -1) {
+    return;
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, t->pidfd, NULL);
+  pidfd_tasks[t->pidfd] = NULL;
+  close(t->pidfd);
+  t->pidfd = -1;
+}
+
+
+void signal_task(task* t, int sig) {
+  if (t->pidfd != -1) {
+    pidfd_send_signal(t->pidfd, sig, NULL, 0);
+  }
+  else {
+    kill(t->pid, sig);
   }
+}
 
-  char label[64];
-  unsigned long value;
 
-  while (fscanf(fp, "%s %lu", label, &value) != EOF) {
-    if (strcmp(label, "wchar:") == 0) {
-      *write_bytes = value;
-      fclose(fp);
-      return 0;
+void reap_children(task_table* tasks) {
+  int status_ptr;
+  pid_t pid;
+
+  while ((pid = waitpid(-1, &status_ptr, WNOHANG)) > 0) {
+    retire_child(tasks, pid, status_ptr);
+  }
+
+  // something went wrong
+  if (pid == -1 && errno != ECHILD) {
+    printf("waitpid error\n");
+    exit(-1);
+  }
+}
+
+
+void reap_task(task_table* tasks, task* t) {
+  int status_ptr;
+
+  // the pid can't have been reused, it is ours until this waitpid
+  if (waitpid(t->pid, &status_ptr, WNOHANG) == t->pid) {
+    retire_child(tasks, t->pid, status_ptr);
+  }
+}
+
+
+void retire_child(task_table* tasks, pid_t pid, int status_ptr) {
+  // process terminated
+  if (WIFEXITED(status_ptr)) {
+    printf("PID %d exited with status %d\n", pid, WEXITSTATUS(status_ptr));
+  }
+  else if (WIFSIGNALED(status_ptr)) {
+    printf("PID %d killed by signal %d\n", pid, WTERMSIG(status_ptr));
+  }
+
+  // the kernel sends the exit record before the parent can reap, so it
+  // is already queued and its totals land on the task before it retires
+  if (use_netlink) {
+    netlink_drain(&netlink, netlink.exit_fd, handle_acct_event, tasks);
+  }
+
+  // remove it from the rotation
+  task* t = task_table_find(tasks, pid);
+  if (t == NULL) {
+    return;
+  }
+  t->exited_us = now_us();
+  trace_emit(TRACE_EXIT, pid, t->slot, status_ptr);
+  if (t->state == TASK_BLOCKED) {
+    rq_remove(&parked, t);
+  }
+  else if (rq_queued(t)) {
+    scheduler* sched = slots[t->queue].sched;
+    sched->dequeue(sched, t);
+  }
+  if (t->slot >= 0) {
+    slots[t->slot].current = NULL;
+    disarm_quantum(&slots[t->slot]);
+  }
+  untrack_task(t);
+  close_proc_files(&t->proc);
+  cgroup_remove_job(&cgroups, t->index, &t->cgroup);
+
+  // the task is reused from here on, keep what the totals and metrics need
+  finished_cpu += t->cpu_time;
+  finished_io += t->io_bytes;
+  if (keep_records) {
+    if (num_records == records_cap) {
+      records_cap = records_cap > 0 ? records_cap * 2 : 1024;
+      records = realloc(records, sizeof(task_record) * records_cap);
+      if (records == NULL) {
+        fprintf(stderr, "metrics record allocation failed\n");
+        exit(-1);
+      }
+    }
+    task_record* r = &records[num_records++];
+    r->launched_us = t->launched_us;
+    r->first_run_us = t->first_run_us;
+    r->exited_us = t->exited_us;
+    r->cpu_time = t->cpu_time;
+    r->io_bytes = t->io_bytes;
+    r->cpu_delay_ns = t->cpu_delay_ns;
+    r->blkio_delay_ns = t->blkio_delay_ns;
+  }
+  task_table_remove(tasks, t);
+}
+
+
+int setup_slots(int num_cores, int pin, int shared, const char* policy, long quantum_us) {
+  cpu_set_t allowed;
+  int cpu = -1;
+
+  // only use CPUs the MCP itself may run on
+  if (pin) {
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    if (num_cores > CPU_COUNT(&allowed)) {
+      printf("only %d CPUs available, using %d cores\n", CPU_COUNT(&allowed), CPU_COUNT(&allowed));
+      num_cores = CPU_COUNT(&allowed);
     }
   }
 
-  fclose(fp);
-  // no value found
-  return -1;
+  num_schedulers = shared ? 1 : num_cores;
+  slots = calloc(num_cores, sizeof(cpu_slot));
+  schedulers = calloc(num_schedulers, sizeof(scheduler));
+  if (slots == NULL || schedulers == NULL) {
+    fprintf(stderr, "slot allocation failed\n");
+    exit(-1);
+  }
+  num_slots = num_cores;
+
+  for (int i = 0; i < num_schedulers; ++i) {
+    if (scheduler_init(&schedulers[i], policy, quantum_us) == -1) {
+      free_slots();
+      return -1;
+    }
+  }
+
+  for (int i = 0; i < num_slots; ++i) {
+    slots[i].cpu = -1;
+    slots[i].sched = &schedulers[shared ? 0 : i];
+    if (pin) {
+      // next allowed CPU
+      do {
+        ++cpu;
+      } while (!CPU_ISSET(cpu, &allowed));
+      slots[i].cpu = cpu;
+    }
+    slots[i].timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (slots[i].timer_fd == -1) {
+      perror("timerfd_create");
+      exit(-1);
+    }
+  }
+  return 0;
+}
+
+
+void free_slots() {
+  for (int i = 0; i < num_slots; ++i) {
+    if (slots[i].timer_fd > 0) {
+      close(slots[i].timer_fd);
+    }
+  }
+  for (int i = 0; i < num_schedulers; ++i) {
+    free_scheduler(&schedulers[i]);
+  }
+  free(slots);
+  free(schedulers);
+  slots = NULL;
+  schedulers = NULL;
+  num_slots = 0;
+  num_schedulers = 0;
+}
+
+
+cpu_slot* slot_for_timer(int fd) {
+  // there are only as many slots as cores
+  for (int i = 0; i < num_slots; ++i) {
+    if (slots[i].timer_fd == fd) {
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+
+int setup_event_loop(sigset_t* signals) {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  signal_fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  if (epoll_fd == -1 || signal_fd == -1) {
+    perror("setup_event_loop");
+    exit(-1);
+  }
+
+  // children stopping on SIGSTOP every quantum shouldn't wake the loop
+  struct sigaction sa = {0};
+  sa.sa_handler = SIG_DFL;
+  sa.sa_flags = SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &sa, NULL);
+
+  // watch the signalfd and every slot's timer for readability
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = signal_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+  if (use_netlink) {
+    ev.data.fd = netlink.exit_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, netlink.exit_fd, &ev);
+    if (netlink.connector_fd != -1) {
+      ev.data.fd = netlink.connector_fd;
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, netlink.connector_fd, &ev);
+    }
+  }
+  for (int i = 0; i < num_slots; ++i) {
+    ev.data.fd = slots[i].timer_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, slots[i].timer_fd, &ev);
+  }
+
+  // epoll refuses regular files with EPERM, those are read without waiting
+  ev.data.fd = input.fd;
+  if (input.fd != -1 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, input.fd, &ev) == 0) {
+    input_pollable = 1;
+    input_watched = 1;
+  }
+
+  return epoll_fd;
+}
+
+
+void arm_quantum(cpu_slot* slot, long quantum_us) {
+  // one-shot timer, re-armed on every context switch like alarm(). The
+  // deadline is absolute so jitter can be measured against it
+  struct timespec* deadline = &slot->deadline;
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += quantum_us / 1000000;
+  deadline->tv_nsec += (quantum_us % 1000000) * 1000;
+  if (deadline->tv_nsec >= 1000000000) {
+    deadline->tv_sec += 1;
+    deadline->tv_nsec -= 1000000000;
+  }
+
+  struct itimerspec spec = {0};
+  spec.it_value = *deadline;
+  if (timerfd_settime(slot->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+    perror("timerfd_settime");
+    exit(-1);
+  }
+}
+
+
+long next_quantum(cpu_slot* slot, task* t) {
+  if (adaptive) {
+    return tuner_quantum(&tuner, slot->sched, t);
+  }
+  return slot->sched->task_quantum(slot->sched, t);
+}
+
+
+void start_quantum(cpu_slot* slot, task* t) {
+  arm_quantum(slot, next_quantum(slot, t));
+  if (io_probe_us > 0) {
+    arm_probe(slot);
+  }
+}
+
+
+void arm_probe(cpu_slot* slot) {
+  struct timespec probe;
+  clock_gettime(CLOCK_MONOTONIC, &probe);
+  probe.tv_sec += io_probe_us / 1000000;
+  probe.tv_nsec += (io_probe_us % 1000000) * 1000;
+  if (probe.tv_nsec >= 1000000000) {
+    probe.tv_sec += 1;
+    probe.tv_nsec -= 1000000000;
+  }
+
+  // the deadline itself ends the quantum, no probe needed that late
+  slot->probing = probe.tv_sec < slot->deadline.tv_sec ||
+    (probe.tv_sec == slot->deadline.tv_sec && probe.tv_nsec < slot->deadline.tv_nsec);
+  struct itimerspec spec = {0};
+  spec.it_value = slot->probing ? probe : slot->deadline;
+  if (timerfd_settime(slot->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+    perror("timerfd_settime");
+    exit(-1);
+  }
+}
+
+
+void handle_probe(cpu_slot* slot) {
+  slot->probing = 0;
+  task* t = slot->current;
+  if (t == NULL) {
+    return;
+  }
+
+  // parking only pays off if something else can have the slot
+  if (busiest_slot()->sched->nr_ready > 0 && probe_asleep(t) == 1) {
+    park_task(slot);
+    schedule_next_proc(slot);
+    return;
+  }
+  arm_probe(slot);
+}
+
+
+int probe_asleep(task* t) {
+  // stat alone, state and CPU time, is all a probe needs
+  proc_sample sample;
+  if (sample_proc_stat(&t->proc, &sample) == -1) {
+    return -1;
+  }
+
+  // a job's other processes may be busy while the one we started waits
+  // for them, only the cgroup sees their CPU time
+  if (t->cgroup.dir_fd != -1) {
+    cgroup_sample(&t->cgroup, &sample);
+  }
+  double cpu = sample.utime + sample.stime;
+  int progressed = cpu != t->probe_cpu;
+  t->probe_cpu = cpu;
+
+  // one S or D sample may just be a short wait between bursts, asleep
+  // means no CPU used since the last probe either, so a parked task that
+  // keeps computing is woken and stopped again by the next check
+  if (sample.state != 'S' && sample.state != 'D') {
+    return 0;
+  }
+  return progressed ? 0 : 1;
+}
+
+
+void park_task(cpu_slot* slot) {
+  task* t = slot->current;
+  account_current(slot->sched, t);
+  trace_emit(TRACE_PARK, t->pid, t->slot, 0);
+
+  // out of the rotation but running, its sleep ends on its own
+  t->state = TASK_BLOCKED;
+  t->slot = -1;
+  slot->current = NULL;
+  rq_push(&parked, t);
+  ++total_parks;
+
+  // left before its deadline, there is no lateness to measure
+  slot->deadline.tv_sec = 0;
+
+  // the first parked task starts the periodic check
+  if (parked.size == 1) {
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = io_probe_us / 1000000;
+    spec.it_value.tv_nsec = (io_probe_us % 1000000) * 1000;
+    spec.it_interval = spec.it_value;
+    timerfd_settime(park_timer_fd, 0, &spec, NULL);
+  }
+}
+
+
+void wake_parked() {
+  long long now = now_us();
+  int count = parked.size;
+  task* t = parked.head;
+  for (int i = 0; i < count; ++i) {
+    task* next = t->rq_next;
+
+    // an exit is reaped through its pidfd or SIGCHLD, it stays until then
+    if (probe_asleep(t) == 0) {
+      rq_remove(&parked, t);
+      stop_task(t);
+      trace_emit(TRACE_WAKE, t->pid, -1, 0);
+      t->state = TASK_READY;
+      t->stopped_us = now;
+      t->boosted = 1;
+      enqueue_task(&slots[t->queue], t);
+      ++total_wakes;
+    }
+    t = next;
+  }
+
+  if (parked.size == 0) {
+    struct itimerspec spec = {0};
+    timerfd_settime(park_timer_fd, 0, &spec, NULL);
+  }
+  fill_idle_slots();
+}
+
+
+int parse_quantum_range(const char* str, long* min_us, long* max_us) {
+  char bound[64];
+  const char* comma = strchr(str, ',');
+  if (comma == NULL || comma - str >= (long)sizeof(bound)) {
+    return -1;
+  }
+  memcpy(bound, str, comma - str);
+  bound[comma - str] = '\0';
+  if (parse_quantum(bound, min_us) == -1 || parse_quantum(comma + 1, max_us) == -1 || *min_us > *max_us) {
+    return -1;
+  }
+  return 0;
+}
+
+
+void disarm_quantum(cpu_slot* slot) {
+  // a zero it_value stops the timer
+  struct itimerspec spec = {0};
+  timerfd_settime(slot->timer_fd, 0, &spec, NULL);
+  slot->deadline.tv_sec = 0;
+  slot->probing = 0;
+}
+
+
+void record_switch_jitter(cpu_slot* slot) {
+  // only switches at the end of a quantum have a deadline to miss
+  if (slot->deadline.tv_sec == 0) {
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  double late_us = (now.tv_sec - slot->deadline.tv_sec) * 1e6
+                 + (now.tv_nsec - slot->deadline.tv_nsec) / 1e3;
+
+  if (jitter.samples == 0 || late_us < jitter.min_us) {
+    jitter.min_us = late_us;
+  }
+  if (jitter.samples == 0 || late_us > jitter.max_us) {
+    jitter.max_us = late_us;
+  }
+  jitter.total_us += late_us;
+  jitter.total_sq_us += late_us * late_us;
+  ++jitter.samples;
+}
+
+
+void print_jitter_report() {
+  if (jitter.samples == 0) {
+    printf("jitter: no context switches recorded\n");
+    return;
+  }
+
+  double mean = jitter.total_us / jitter.samples;
+  double variance = jitter.total_sq_us / jitter.samples - mean * mean;
+  printf("jitter: %ld switches, min %.1f us, mean %.1f us, max %.1f us, stddev %.1f us\n",
+    jitter.samples,
+    jitter.min_us,
+    mean,
+    jitter.max_us,
+    variance > 0 ? sqrt(variance) : 0.0
+    );
+}
+
+
+char* serve_request(const char* request, size_t* len, void* ctx) {
+  task_table* tasks = ctx;
+  char* reply = NULL;
+  FILE* out = open_memstream(&reply, len);
+  if (out == NULL) {
+    return NULL;
+  }
+
+  // a command word, then its arguments
+  char command[16] = "";
+  int command_len = 0;
+  sscanf(request, "%15s%n", command, &command_len);
+  const char* args = request + command_len;
+  while (*args == ' ' || *args == '\t') {
+    ++args;
+  }
+
+  if (strcmp(command, "json") == 0) {
+    write_status_json(out, tasks);
+  }
+  else if (strcmp(command, "metrics") == 0 || command[0] == '\0') {
+    write_status_prometheus(out, tasks);
+  }
+  else if (strcmp(command, "add") == 0) {
+    request_add(out, tasks, args);
+  }
+  else if (strcmp(command, "drain") == 0) {
+    request_drain(out, tasks);
+  }
+  else if (strcmp(command, "kill") == 0 || strcmp(command, "suspend") == 0 || strcmp(command, "resume") == 0 ||
+           strcmp(command, "weight") == 0 || strcmp(command, "quantum") == 0 || strcmp(command, "prio") == 0) {
+    request_job(out, tasks, command, args);
+  }
+  else {
+    fprintf(out, "error: unknown request '%s', expected json, metrics, add, kill, suspend, resume, "
+                 "weight, quantum, prio or drain\n", command);
+  }
+  fclose(out);
+  return reply;
+}
+
+
+void request_add(FILE* out, task_table* tasks, const char* line) {
+  if (draining) {
+    fprintf(out, "error: draining, no new jobs\n");
+    return;
+  }
+
+  // check it parses now, the client won't be around to hear about it later
+  char* copy = strdup(line);
+  command_line cmd;
+  job_hints hints;
+  int num_args = copy != NULL ? parse_job(&job_args, copy, &cmd, &hints) : 0;
+  arena_reset(&job_args);
+  free(copy);
+  if (num_args <= 0) {
+    fprintf(out, "error: %s\n", num_args == -1 ? "unterminated quote" : num_args == -2 ? "bad annotation" : "empty command");
+    return;
+  }
+
+  if (num_submitted == submitted_cap) {
+    submitted_cap = submitted_cap > 0 ? submitted_cap * 2 : 16;
+    submitted = realloc(submitted, sizeof(char*) * submitted_cap);
+    if (submitted == NULL) {
+      fprintf(stderr, "submitted job allocation failed\n");
+      exit(-1);
+    }
+  }
+  submitted[num_submitted++] = strdup(line);
+
+  // submitted lines go first, so the first task launched is this one
+  int first = tasks->count;
+  ingest_jobs(tasks);
+  update_input_watch(tasks);
+  fill_idle_slots();
+  task* t = tasks->count > first ? task_table_find_index(tasks, first) : NULL;
+  if (t != NULL) {
+    fprintf(out, "ok job %d pid %d\n", t->index, t->pid);
+  }
+  else {
+    fprintf(out, "ok queued, %d jobs are live\n", tasks->num_live);
+  }
+}
+
+
+void request_job(FILE* out, task_table* tasks, const char* command, const char* args) {
+  int index;
+  int consumed = 0;
+  if (sscanf(args, "%d%n", &index, &consumed) != 1 || index < 0 || index >= tasks->count) {
+    fprintf(out, "error: no job '%s'\n", args);
+    return;
+  }
+  task* t = task_table_find_index(tasks, index);
+  if (t == NULL) {
+    fprintf(out, "error: job %d has exited\n", index);
+    return;
+  }
+  const char* value = args + consumed;
+  while (*value == ' ' || *value == '\t') {
+    ++value;
+  }
+
+  if (strcmp(command, "kill") == 0) {
+    // reaped like any other exit, through its pidfd or SIGCHLD
+    if (t->cgroup.dir_fd != -1) {
+      cgroup_kill(&t->cgroup);
+    }
+    signal_task(t, SIGKILL);
+  }
+  else if (strcmp(command, "suspend") == 0) {
+    if (t->state == TASK_SUSPENDED) {
+      fprintf(out, "error: job %d is already suspended\n", index);
+      return;
+    }
+    suspend_task(t);
+  }
+  else if (strcmp(command, "resume") == 0) {
+    if (t->state != TASK_SUSPENDED) {
+      fprintf(out, "error: job %d is not suspended\n", index);
+      return;
+    }
+    // back on the queue it left, its wait starts over
+    t->state = TASK_READY;
+    t->stopped_us = now_us();
+    enqueue_task(&slots[t->queue], t);
+    fill_idle_slots();
+  }
+  else if (strcmp(command, "quantum") == 0) {
+    long quantum_us;
+    if (parse_quantum(value, &quantum_us) == -1) {
+      fprintf(out, "error: invalid quantum '%s'\n", value);
+      return;
+    }
+    // read when its next quantum is armed
+    t->quantum_us = quantum_us;
+  }
+  else {
+    // same ranges as the @weight and @prio annotations
+    int is_weight = strcmp(command, "weight") == 0;
+    long low = is_weight ? 1 : -1000;
+    long high = is_weight ? 10000 : 1000;
+    char* end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || n < low || n > high) {
+      fprintf(out, "error: invalid %s '%s', expected %ld to %ld\n", command, value, low, high);
+      return;
+    }
+    if (strcmp(command, "weight") == 0) {
+      // only future slices are charged at the new weight, O(1)
+      t->weight = n;
+      if (t->cgroup.dir_fd != -1 && cgroups.has_cpu) {
+        cgroup_set_cpu(&t->cgroup, t->weight, 0);
+      }
+    }
+    else {
+      // priority orders the heaps, so a queued task moves, O(log n)
+      int queued = t->state == TASK_READY;
+      scheduler* sched = slots[t->queue].sched;
+      if (queued) {
+        sched->dequeue(sched, t);
+      }
+      t->priority = n;
+      if (queued) {
+        sched->enqueue(sched, t);
+      }
+    }
+  }
+  fprintf(out, "ok\n");
+}
+
+
+void suspend_task(task* t) {
+  if (t->state == TASK_RUNNING) {
+    // charge the partial slice and hand the slot on right away
+    cpu_slot* slot = &slots[t->slot];
+    account_current(slot->sched, t);
+    stop_task(t);
+    trace_emit(TRACE_PREEMPT, t->pid, t->slot, 0);
+    slot->current = NULL;
+    t->slot = -1;
+    t->stopped_us = now_us();
+    t->state = TASK_SUSPENDED;
+    schedule_next_proc(slot);
+    return;
+  }
+
+  // parked, it was never stopped
+  if (t->state == TASK_BLOCKED) {
+    rq_remove(&parked, t);
+    stop_task(t);
+    t->state = TASK_SUSPENDED;
+    return;
+  }
+
+  // already stopped, it just leaves its queue
+  scheduler* sched = slots[t->queue].sched;
+  sched->dequeue(sched, t);
+  t->wait_us = task_wait_us(t, now_us());
+  t->state = TASK_SUSPENDED;
+}
+
+
+void request_drain(FILE* out, task_table* tasks) {
+  draining = 1;
+
+  // unlaunched work is dropped, the input is left unread
+  for (int i = submitted_head; i < num_submitted; ++i) {
+    free(submitted[i]);
+  }
+  submitted_head = 0;
+  num_submitted = 0;
+  input.done = 1;
+  next_compiled = compiled.num_jobs;
+  if (out != NULL) {
+    update_input_watch(tasks);
+    fprintf(out, "ok draining, %d jobs are live\n", tasks->num_live);
+  }
+}
+
+
+void write_status_json(FILE* out, task_table* tasks) {
+  long long now = now_us();
+  int ready = 0;
+  int running = 0;
+  for (int i = 0; i < num_schedulers; ++i) {
+    ready += schedulers[i].nr_ready;
+  }
+  for (int i = 0; i < num_slots; ++i) {
+    running += slots[i].current != NULL;
+  }
+
+  // totals over every job ever launched, finished ones included
+  double cpu_time = finished_cpu;
+  unsigned long long io_bytes = finished_io;
+  task* t = tasks->live_head;
+  for (int i = 0; i < tasks->num_live; ++i, t = t->live_next) {
+    cpu_time += t->cpu_time;
+    io_bytes += t->io_bytes;
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(out, "{\"uptime_s\": %.3f, \"policy\": \"%s\", \"jobs\": %d, \"live\": %d, \"finished\": %d, "
+               "\"ready\": %d, \"running\": %d, \"dispatches\": %lu, \"migrations\": %lu, "
+               "\"cpu_s\": %.3f, \"io_bytes\": %llu, \"mcp_cpu_s\": %.3f,\n\"tasks\": [",
+    (now - started_us) / 1e6,
+    schedulers[0].name,
+    tasks->count,
+    tasks->num_live,
+    tasks->count - tasks->num_live,
+    ready,
+    running,
+    total_dispatches,
+    total_migrations,
+    cpu_time,
+    io_bytes,
+    usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6
+    );
+
+  // CPU time and I/O are as of the job's last sample, a request never samples
+  t = tasks->live_head;
+  for (int i = 0; i < tasks->num_live; ++i, t = t->live_next) {
+    fprintf(out, "%s\n  {\"job\": %d, \"pid\": %d, \"state\": \"%s\", \"slot\": %d, \"level\": %d, "
+                 "\"cpu_s\": %.3f, \"io_bytes\": %lu, \"wait_s\": %.3f, \"dispatches\": %d}",
+      i > 0 ? "," : "",
+      t->index,
+      t->pid,
+      t->state == TASK_RUNNING ? "running" : t->state == TASK_SUSPENDED ? "suspended" :
+      t->state == TASK_BLOCKED ? "blocked" : "ready",
+      t->slot,
+      t->level,
+      t->cpu_time,
+      t->io_bytes,
+      task_wait_us(t, now) / 1e6,
+      t->dispatches
+      );
+  }
+  fprintf(out, "\n]}\n");
+}
+
+
+void write_status_prometheus(FILE* out, task_table* tasks) {
+  long long now = now_us();
+  int ready = 0;
+  for (int i = 0; i < num_schedulers; ++i) {
+    ready += schedulers[i].nr_ready;
+  }
+
+  fprintf(out, "# HELP mcp_jobs_launched_total Jobs launched since the MCP started\n"
+               "# TYPE mcp_jobs_launched_total counter\n"
+               "mcp_jobs_launched_total %d\n"
+               "# HELP mcp_jobs_live Jobs not yet reaped\n"
+               "# TYPE mcp_jobs_live gauge\n"
+               "mcp_jobs_live %d\n"
+               "# HELP mcp_jobs_ready Jobs waiting in a run queue\n"
+               "# TYPE mcp_jobs_ready gauge\n"
+               "mcp_jobs_ready %d\n"
+               "# HELP mcp_dispatches_total Times a job was given a slot\n"
+               "# TYPE mcp_dispatches_total counter\n"
+               "mcp_dispatches_total %lu\n"
+               "# HELP mcp_migrations_total Dispatches onto a different slot than the job last ran on\n"
+               "# TYPE mcp_migrations_total counter\n"
+               "mcp_migrations_total %lu\n",
+    tasks->count,
+    tasks->num_live,
+    ready,
+    total_dispatches,
+    total_migrations
+    );
+
+  // one family at a time, as the format wants
+  const char* families[] = {
+    "mcp_job_cpu_seconds_total", "counter", "CPU time as of the job's last sample",
+    "mcp_job_io_bytes_total", "counter", "Bytes read and written as of the job's last sample",
+    "mcp_job_wait_seconds_total", "counter", "Time spent ready but not running",
+    "mcp_job_dispatches_total", "counter", "Times the job was given a slot",
+    "mcp_job_level", "gauge", "Scheduler queue level, 0 is the highest",
+    "mcp_job_running", "gauge", "1 while the job holds a slot"
+  };
+  for (int f = 0; f < 6; ++f) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", families[f * 3], families[f * 3 + 2], families[f * 3], families[f * 3 + 1]);
+    task* t = tasks->live_head;
+    for (int i = 0; i < tasks->num_live; ++i, t = t->live_next) {
+      fprintf(out, "%s{job=\"%d\",pid=\"%d\"} ", families[f * 3], t->index, t->pid);
+      switch (f) {
+        case 0: fprintf(out, "%.3f\n", t->cpu_time); break;
+        case 1: fprintf(out, "%lu\n", t->io_bytes); break;
+        case 2: fprintf(out, "%.3f\n", task_wait_us(t, now) / 1e6); break;
+        case 3: fprintf(out, "%d\n", t->dispatches); break;
+        case 4: fprintf(out, "%d\n", t->level); break;
+        case 5: fprintf(out, "%d\n", t->state == TASK_RUNNING); break;
+      }
+    }
+  }
+}
+
+
+long long task_wait_us(task* t, long long now) {
+  if (t->state != TASK_READY) {
+    return t->wait_us;
+  }
+  // ready since it was last preempted, or since it was launched
+  return t->wait_us + now - (t->stopped_us != 0 ? t->stopped_us : t->launched_us);
+}
+
+
+int write_metrics(task_table* tasks, const char* path, long quantum_us) {
+  // finished jobs from their records, any still live from their tasks
+  int num_jobs = num_records + tasks->num_live;
+  task_record* jobs = malloc(sizeof(task_record) * (num_jobs > 0 ? num_jobs : 1));
+  double* turnaround = malloc(sizeof(double) * (num_jobs > 0 ? num_jobs : 1));
+  double* response = malloc(sizeof(double) * (num_jobs > 0 ? num_jobs : 1));
+  if (jobs == NULL || turnaround == NULL || response == NULL) {
+    free(jobs);
+    free(turnaround);
+    free(response);
+    return -1;
+  }
+  if (num_records > 0) {
+    memcpy(jobs, records, sizeof(task_record) * num_records);
+  }
+  task* live = tasks->live_head;
+  for (int i = num_records; i < num_jobs; ++i, live = live->live_next) {
+    jobs[i].launched_us = live->launched_us;
+    jobs[i].first_run_us = live->first_run_us;
+    jobs[i].exited_us = live->exited_us;
+    jobs[i].cpu_time = live->cpu_time;
+    jobs[i].io_bytes = live->io_bytes;
+    jobs[i].cpu_delay_ns = live->cpu_delay_ns;
+    jobs[i].blkio_delay_ns = live->blkio_delay_ns;
+  }
+
+  // jobs killed along with the MCP never finished and count for nothing
+  long long first_launch = 0;
+  long long last_exit = 0;
+  double turnaround_sum = 0;
+  double response_sum = 0;
+  int finished = 0;
+  int started = 0;
+  double job_cpu = 0;
+  unsigned long long job_io = 0;
+  unsigned long long cpu_delay_ns = 0;
+  unsigned long long blkio_delay_ns = 0;
+  for (int i = 0; i < num_jobs; ++i) {
+    task_record* t = &jobs[i];
+
+    // exact lifetime totals under netlink, the last sample otherwise
+    job_cpu += t->cpu_time;
+    job_io += t->io_bytes;
+    cpu_delay_ns += t->cpu_delay_ns;
+    blkio_delay_ns += t->blkio_delay_ns;
+    if (first_launch == 0 || t->launched_us < first_launch) {
+      first_launch = t->launched_us;
+    }
+    if (t->first_run_us != 0) {
+      response[started] = (t->first_run_us - t->launched_us) / 1e6;
+      response_sum += response[started++];
+    }
+    if (t->exited_us != 0) {
+      turnaround[finished] = (t->exited_us - t->launched_us) / 1e6;
+      turnaround_sum += turnaround[finished++];
+      if (t->exited_us > last_exit) {
+        last_exit = t->exited_us;
+      }
+    }
+  }
+  qsort(turnaround, finished, sizeof(double), compare_doubles);
+  qsort(response, started, sizeof(double), compare_doubles);
+
+  // the MCP's own CPU, children are not included
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double mcp_cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                   usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  double makespan = last_exit > first_launch ? (last_exit - first_launch) / 1e6 : 0.0;
+
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    free(jobs);
+    free(turnaround);
+    free(response);
+    return -1;
+  }
+  fprintf(out, "{\"policy\": \"%s\", \"quantum_us\": %ld, \"cores\": %d, \"jobs\": %d, \"finished\": %d, "
+               "\"makespan_s\": %.6f, \"turnaround_mean_s\": %.6f, \"turnaround_p99_s\": %.6f, "
+               "\"response_mean_s\": %.6f, \"response_p99_s\": %.6f, \"context_switches\": %lu, "
+               "\"migrations\": %lu, \"mcp_cpu_s\": %.6f, \"mcp_overhead_pct\": %.3f, "
+               "\"job_cpu_s\": %.6f, \"job_io_bytes\": %llu, \"cpu_delay_s\": %.6f, \"io_delay_s\": %.6f}\n",
+    schedulers[0].name,
+    quantum_us,
+    num_slots,
+    tasks->count,
+    finished,
+    makespan,
+    finished > 0 ? turnaround_sum / finished : 0.0,
+    percentile(turnaround, finished, 0.99),
+    started > 0 ? response_sum / started : 0.0,
+    percentile(response, started, 0.99),
+    total_dispatches,
+    total_migrations,
+    mcp_cpu,
+    makespan > 0 ? mcp_cpu * 100.0 / makespan : 0.0,
+    job_cpu,
+    job_io,
+    cpu_delay_ns / 1e9,
+    blkio_delay_ns / 1e9
+    );
+  fclose(out);
+  free(jobs);
+  free(turnaround);
+  free(response);
+  return 0;
+}
+
+
+double percentile(double* values, int n, double p) {
+  if (n == 0) {
+    return 0.0;
+  }
+  int rank = (int)ceil(p * n);
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+
+int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+
+int next_job(command_line* cmd, job_hints* hints) {
+  // jobs added on the control socket go first, copied to the arena so
+  // their arguments last until the batch is launched
+  while (submitted_head < num_submitted) {
+    char* added = submitted[submitted_head++];
+    char* line = arena_alloc(&job_args, strlen(added) + 1);
+    strcpy(line, added);
+    free(added);
+    if (submitted_head == num_submitted) {
+      submitted_head = 0;
+      num_submitted = 0;
+    }
+    if (parse_job(&job_args, line, cmd, hints) > 0) {
+      return 1;
+    }
+  }
+  if (draining) {
+    return -1;
+  }
+
+  if (use_compiled) {
+    while (next_compiled < compiled.num_jobs) {
+      if (compiled_job(&compiled, &job_args, next_compiled++, cmd, hints) == 0) {
+        return 1;
+      }
+      fprintf(stderr, "compiled job %d is damaged, skipping\n", next_compiled - 1);
+    }
+    input.done = 1;
+    return -1;
+  }
+
+  // the arguments stay in the reader's buffer, nothing to free
+  char* line;
+  int status;
+  while ((status = line_reader_next(&input, &line)) == 1) {
+    int num_args = parse_job(&job_args, line, cmd, hints);
+    if (num_args == -1) {
+      fprintf(stderr, "unterminated quote, skipping line\n");
+    }
+    else if (num_args == -2) {
+      fprintf(stderr, "bad annotation, skipping line\n");
+    }
+    else if (num_args > 0) {
+      return 1;
+    }
+  }
+  return status;
+}
+
+
+int ingest_jobs(task_table* tasks) {
+  long long start_us = now_us();
+  command_line token_buffer;
+  job_hints hints;
+  int status = 0;
+
+  // launched tasks are reused slots, not contiguous, so the batch keeps them
+  task* batch[INGEST_BATCH];
+  int launched = 0;
+
+  // nothing to launch, skip the barrier setup
+  if (tasks->num_live >= MAX_LIVE_TASKS || (status = next_job(&token_buffer, &hints)) != 1) {
+    input_backlog = 0;
+    arena_reset(&job_args);
+    return 0;
+  }
+
+  // a child inherits anything still buffered and would print it again
+  fflush(stdout);
+
+  // one barrier per batch, every child forked below shares it
+  if (!use_spawn && barrier_init(&barrier) == -1) {
+    fprintf(stderr, "launch barrier setup failed\n");
+    exit(-1);
+  }
+
+  do {
+    // the cgroup is ready before the process, which joins it before exec
+    job_cgroup job = {-1, -1, -1, -1};
+    if (use_cgroup && cgroup_create_job(&cgroups, tasks->count, &job) == 0 && cgroups.has_cpu) {
+      cgroup_set_cpu(&job, hints.weight, cpu_max_percent);
+    }
+
+    pid_t child_process;
+    if (use_spawn) {
+      child_process = spawn_child_process(token_buffer);
+    }
+    else {
+      child_process = fork();
+      init_child_process(child_process, token_buffer);
+    }
+
+    // nothing was started, there is no process to schedule
+    if (child_process == -1) {
+      cgroup_remove_job(&cgroups, tasks->count, &job);
+      continue;
+    }
+
+    // a forked child is still held at the barrier, a spawned one stopped
+    if (job.dir_fd != -1 && cgroup_attach(&job, child_process) == -1) {
+      cgroup_remove_job(&cgroups, tasks->count, &job);
+    }
+
+    // spread the tasks evenly over the slots' run queues
+    task* t = task_table_add(tasks, child_process);
+    batch[launched++] = t;
+    t->priority = hints.priority;
+    t->weight = hints.weight > 0 ? hints.weight : 1;
+    t->quantum_us = hints.quantum_us;
+    t->cpus = hints.cpus;
+    t->cgroup = job;
+    t->launched_us = now_us();
+    track_task(t);
+    trace_emit(TRACE_SPAWN, t->pid, -1, t->index);
+    open_proc_files(child_process, &t->proc);
+
+    // hand a spawned child's stop over to the freezer
+    if (use_spawn && t->cgroup.dir_fd != -1) {
+      cgroup_freeze(&t->cgroup, 1);
+      signal_task(t, SIGCONT);
+    }
+    enqueue_task(slot_for_new_task(t), t);
+  } while (launched < INGEST_BATCH && tasks->num_live < MAX_LIVE_TASKS &&
+           (status = next_job(&token_buffer, &hints)) == 1);
+
+  // stopped by a limit rather than by running out of lines
+  input_backlog = status == 1;
+
+  // Spawned children are stopped already, forked ones wait at the barrier
+  if (!use_spawn) {
+    // Wait until every child is ready to exec, then release them all at once
+    int ready = barrier_wait_ready(&barrier, launched);
+    if (ready > 0) {
+      printf("%d of %d processes ready, releasing\n", ready, launched);
+    }
+    barrier_release(&barrier);
+
+    // Send SIGSTOP to each child process, or freeze its cgroup
+    for(int i = 0; i < launched; ++i) {
+      task* t = batch[i];
+      printf("%s process %d PID: %d\n", t->cgroup.dir_fd != -1 ? "Freezing" : "Sending SIGSTOP to ", i, t->pid);
+      stop_task(t);
+    }
+  }
+
+  arena_reset(&job_args);
+  launch_us += now_us() - start_us;
+  return launched;
+}
+
+
+void update_input_watch(task_table* tasks) {
+  int watch = input_pollable && !input.done && tasks->num_live < MAX_LIVE_TASKS;
+  if (watch == input_watched) {
+    return;
+  }
+
+  // removed rather than masked, a hung up pipe reports EPOLLHUP regardless
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = input.fd;
+  epoll_ctl(epoll_fd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, input.fd, &ev);
+  input_watched = watch;
+}
+
+
+int init_child_process(pid_t child_process, command_line token_buffer) {
+  // handle fork
+  if (child_process < 0) {
+    fprintf(stderr, "fork failed\n");
+    exit(-1);
+  }
+  else if (child_process == 0) {
+    printf("I am a child process with PID: %d\n", getpid());
+    char** args = token_buffer.command_list;
+    
+    // suspend execution of the child process until every child is ready
+    printf("PID %d waiting at launch barrier\n", getpid());
+    barrier_child_wait(&barrier);
+    printf("PID %d released\n", getpid());
+
+    // don't hand the MCP's blocked signals down to the workload
+    sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+
+    // the rest of the job list is the MCP's, not the workload's
+    if (input.fd == STDIN_FILENO) {
+      int null_fd = open("/dev/null", O_RDONLY);
+      dup2(null_fd, STDIN_FILENO);
+      close(null_fd);
+    }
+
+    // handle errors
+    if (execvp(args[0], args) < 0) {
+      printf("execvp() failed for '%s'\n", args[0]);
+      exit(-1);
+    };
+  }
+}
+
+pid_t spawn_child_process(command_line token_buffer) {
+  char** args = token_buffer.command_list;
+  pid_t pid;
+
+  // don't hand the MCP's blocked signals down to the workload
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+  posix_spawnattr_setsigmask(&attr, &child_sigmask);
+
+  // the rest of the job list is the MCP's, not the workload's
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (input.fd == STDIN_FILENO) {
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  }
+
+  // glibc spawns with clone(CLONE_VM | CLONE_VFORK), no page tables are
+  // copied and the call returns once the exec has succeeded or failed
+  int err = posix_spawnp(&pid, args[0], &actions, &attr, args, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (err != 0) {
+    printf("posix_spawnp() failed for '%s': %s\n", args[0], strerror(err));
+    return -1;
+  }
+
+  // the workload may run briefly before this lands, like a forked child
+  // between the barrier release and its SIGSTOP
+  kill(pid, SIGSTOP);
+  return pid;
+}
+
+
+void report(task_table* tasks) {
+  // netlink keeps the counters on the tasks instead of scanning every
+  // child every tick. They are as of each task's last slice, exact totals
+  // arrive in the exit record
+  if (use_netlink) {
+    printf("PID \t STATE \t CPU TIME \t READ + WRITE \n");
+    task* t = tasks->live_head;
+    for (int i = 0; i < tasks->num_live; ++i, t = t->live_next) {
+      printf("%d \t %c \t %lf \t %-12lu \n",
+        t->pid,
+        t->state == TASK_RUNNING ? 'R' : t->state == TASK_BLOCKED ? 'S' : 'T',
+        t->cpu_time,
+        t->io_bytes
+        );
+    }
+    return;
+  }
+
+  printf("PID \t PROC NAME \t STATE \t USER TIME \t KERNEL TIME \t READ \t WRITE \n");
+
+  // terminated processes are not on the live list
+  task* t = tasks->live_head;
+  for (int i = 0; i < tasks->num_live; ++i, t = t->live_next) {
+    proc_sample sample;
+
+    // exited but not reaped yet
+    if (sample_task(t, &sample) == -1) {
+      continue;
+    }
+
+    // same column format as the original fscanf'd "(name)" token
+    char name[sizeof(sample.name) + 2];
+    snprintf(name, sizeof(name), "(%s)", sample.name);
+
+    printf("%d \t %-8s \t %c \t %lf \t %lf \t %lu \t %-12lu \n",
+      t->pid,
+      name,
+      sample.state,
+      sample.utime,
+      sample.stime,
+      sample.rchar,
+      sample.wchar
+      );
+  }
 }
@@ -0,0 +1,209 @@
+// ./proc_sample.c
+
+// Keeps /proc/<pid>/stat, io and status open for the life of each child
+// and re-reads them with pread into a reusable buffer, parsing every field
+// the MCP needs in a single pass. Once the child is reaped pread fails
+// with ESRCH, so a child racing to exit is just a failed sample
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/resource.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Large enough for /proc/<pid>/stat, io and status
+#define SAMPLE_BUFFER_SIZE 4096
+
+
+// Signatures
+
+// Opens /proc/<pid>/<file>, returns the fd or -1
+static int open_proc_file(pid_t pid, const char* file);
+
+// Re-reads the whole of an open /proc file into 'buffer', returns its length or -1
+static ssize_t read_proc_file(int fd, char* buffer);
+
+// Raises the soft open file limit to the hard one, three fds per child add up fast
+static void raise_fd_limit();
+
+// Parses the contents of /proc/<pid>/stat into 'out'
+static int parse_stat(char* buffer, proc_sample* out);
+
+// Parses the contents of /proc/<pid>/io into 'out'
+static void parse_io(char* buffer, proc_sample* out);
+
+// Parses the contents of /proc/<pid>/status into 'out'
+static void parse_status(char* buffer, proc_sample* out);
+
+
+// Globals
+
+// Shared by every sample, the MCP is single threaded
+static char sample_buffer[SAMPLE_BUFFER_SIZE];
+
+// Clock ticks per second for utime/stime
+static long ticks_per_sec = 0;
+
+
+int open_proc_files(pid_t pid, proc_files* files) {
+  static int raised = 0;
+  if (!raised) {
+    raise_fd_limit();
+    raised = 1;
+  }
+
+  files->stat_fd = open_proc_file(pid, "stat");
+  files->io_fd = open_proc_file(pid, "io");
+  files->status_fd = open_proc_file(pid, "status");
+  return files->stat_fd == -1 ? -1 : 0;
+}
+
+
+void close_proc_files(proc_files* files) {
+  int* fds[] = {&files->stat_fd, &files->io_fd, &files->status_fd};
+  for (int i = 0; i < 3; ++i) {
+    if (*fds[i] != -1) {
+      close(*fds[i]);
+      *fds[i] = -1;
+    }
+  }
+}
+
+
+int sample_proc(proc_files* files, proc_sample* out) {
+  memset(out, 0, sizeof(*out));
+
+  if (read_proc_file(files->stat_fd, sample_buffer) == -1 || parse_stat(sample_buffer, out) == -1) {
+    return -1;
+  }
+
+  // io needs ptrace access; without it the counters just stay at 0
+  if (read_proc_file(files->io_fd, sample_buffer) != -1) {
+    parse_io(sample_buffer, out);
+  }
+  return 0;
+}
+
+
+int sample_proc_status(proc_files* files, proc_sample* out) {
+  if (read_proc_file(files->status_fd, sample_buffer) == -1) {
+    return -1;
+  }
+  parse_status(sample_buffer, out);
+  return 0;
+}
+
+
+int sample_proc_stat(proc_files* files, proc_sample* out) {
+  memset(out, 0, sizeof(*out));
+  if (read_proc_file(files->stat_fd, sample_buffer) == -1) {
+    return -1;
+  }
+  return parse_stat(sample_buffer, out);
+}
+
+
+static int open_proc_file(pid_t pid, const char* file) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+
+static ssize_t read_proc_file(int fd, char* buffer) {
+  if (fd == -1) {
+    return -1;
+  }
+
+  ssize_t len = pread(fd, buffer, SAMPLE_BUFFER_SIZE - 1, 0);
+  if (len <= 0) {
+    return -1;
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+
+static void raise_fd_limit() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+
+static int parse_stat(char* buffer, proc_sample* out) {
+  // comm is in parentheses and may itself contain spaces or ')', so it
+  // ends at the last ')' in the line
+  char* open_paren = strchr(buffer, '(');
+  char* close_paren = strrchr(buffer, ')');
+  if (open_paren == NULL || close_paren == NULL || close_paren < open_paren) {
+    return -1;
+  }
+
+  size_t name_len = close_paren - open_paren - 1;
+  if (name_len >= sizeof(out->name)) {
+    name_len = sizeof(out->name) - 1;
+  }
+  memcpy(out->name, open_paren + 1, name_len);
+  out->name[name_len] = '\0';
+
+  // field 3 is the state, utime and stime are fields 14 and 15
+  char* p = close_paren + 2;
+  out->state = *p++;
+
+  unsigned long value = 0;
+  for (int field = 4; field <= 15; ++field) {
+    value = strtoul(p, &p, 10);
+    if (field == 14) {
+      out->utime_ticks = value;
+    }
+  }
+  out->stime_ticks = value;
+
+  if (ticks_per_sec == 0) {
+    ticks_per_sec = sysconf(_SC_CLK_TCK);
+  }
+  out->utime = out->utime_ticks / (double)ticks_per_sec;
+  out->stime = out->stime_ticks / (double)ticks_per_sec;
+  return 0;
+}
+
+
+static void parse_io(char* buffer, proc_sample* out) {
+  // "label: value" lines, rchar and wchar come first
+  char* line = buffer;
+  while (line != NULL && *line != '\0') {
+    if (strncmp(line, "rchar:", 6) == 0) {
+      out->rchar = strtoul(line + 6, NULL, 10);
+    }
+    else if (strncmp(line, "wchar:", 6) == 0) {
+      out->wchar = strtoul(line + 6, NULL, 10);
+      return;
+    }
+    line = strchr(line, '\n');
+    if (line != NULL) {
+      ++line;
+    }
+  }
+}
+
+
+static void parse_status(char* buffer, proc_sample* out) {
+  // the context switch counts are the last two lines, the leading newline
+  // keeps "voluntary" from matching inside "nonvoluntary"
+  char* line = strstr(buffer, "\nvoluntary_ctxt_switches:");
+  if (line != NULL) {
+    out->voluntary_switches = strtoul(line + 25, NULL, 10);
+  }
+  line = strstr(buffer, "nonvoluntary_ctxt_switches:");
+  if (line != NULL) {
+    out->involuntary_switches = strtoul(line + 27, NULL, 10);
+  }
+}
@@ -0,0 +1,144 @@
+// ./quantum_tuner.c
+
+// Adaptive quantum sizing for --adaptive. No single interval suits every
+// job, so the tuner measures two things and sizes each slice from them:
+//  - what a context switch costs: wall time from stopping one task to
+//    resuming the next, plus the MCP's own CPU time for the switch. A
+//    switch every q microseconds costs cost / (q + cost) of the CPU, which
+//    gives the shortest quantum that stays within the target overhead
+//  - how long each task runs before giving up the CPU, from its utime +
+//    stime deltas. A task that used most of its slice has a burst longer
+//    than the slice and its estimate doubles, one that used less blocked
+//    or slept and its burst is the CPU it did use
+// A slice is 5/4 of the task's burst, so most bursts finish within one,
+// but never below the overhead floor. The policy's own scaling still
+// applies, mlfq's lower levels get proportionally longer slices, and the
+// result is clamped to the configured bounds. Like a CFS period, the
+// upper bound is shared by the ready tasks, so a long slice only goes to
+// a task with few others waiting. A job's @quantum, or one
+// set over the control socket, is taken as given.
+// utime/stime only advance in clock ticks, so bursts shorter than a tick
+// read as nothing and those tasks sit at the floor or the lower bound
+
+#include<time.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Fraction of a slice spent on the CPU above which the task used it all
+#define TUNER_FULL_SLICE 0.75
+
+// Slices shorter than this say too little about a burst to count
+#define TUNER_MIN_SAMPLE_US 1000
+
+// Weight of a new switch measurement in the smoothed cost, 1/N
+#define TUNER_SMOOTHING 8
+
+
+// Signatures
+
+// Returns the CPU time used by the calling thread in microseconds
+static long long thread_cpu_us();
+
+
+void tuner_init(quantum_tuner* q, double target_pct, long min_us, long max_us) {
+  q->target_pct = target_pct;
+  q->min_us = min_us;
+  q->max_us = max_us;
+  q->switch_us = 0;
+  q->mcp_cpu_us = 0;
+  q->floor_us = min_us;
+  q->switches = 0;
+  q->slices = 0;
+  q->total_quantum_us = 0;
+  q->begin_cpu_us = 0;
+}
+
+
+void tuner_begin_switch(quantum_tuner* q) {
+  q->begin_cpu_us = thread_cpu_us();
+}
+
+
+void tuner_end_switch(quantum_tuner* q, long long stopped_us) {
+  double latency_us = now_us() - stopped_us;
+  double cpu_us = thread_cpu_us() - q->begin_cpu_us;
+
+  // the first switch seeds the averages, later ones move them gradually
+  if (q->switches == 0) {
+    q->switch_us = latency_us;
+    q->mcp_cpu_us = cpu_us;
+  }
+  else {
+    q->switch_us += (latency_us - q->switch_us) / TUNER_SMOOTHING;
+    q->mcp_cpu_us += (cpu_us - q->mcp_cpu_us) / TUNER_SMOOTHING;
+  }
+  ++q->switches;
+
+  // both are counted in full even where they overlap, so the floor errs long
+  double cost_us = q->switch_us + q->mcp_cpu_us;
+  q->floor_us = cost_us * (100.0 - q->target_pct) / q->target_pct;
+}
+
+
+void tuner_record_slice(quantum_tuner* q, task* t, double cpu_used, long ran_us) {
+  if (ran_us < TUNER_MIN_SAMPLE_US) {
+    return;
+  }
+
+  long long cpu_us = cpu_used * 1e6;
+  long long sample = cpu_us < ran_us * TUNER_FULL_SLICE ? cpu_us : 2LL * ran_us;
+  if (sample > q->max_us) {
+    sample = q->max_us;
+  }
+
+  // 0 means not measured yet, a burst below a tick still counts as one
+  t->burst_us = t->burst_us == 0 ? sample : (t->burst_us + sample) / 2;
+  if (t->burst_us < 1) {
+    t->burst_us = 1;
+  }
+}
+
+
+long tuner_quantum(quantum_tuner* q, scheduler* s, task* t) {
+  long policy_us = s->task_quantum(s, t);
+  if (t->quantum_us > 0) {
+    return policy_us;
+  }
+
+  // until a burst is measured the task gets the base quantum
+  long long base_us = t->burst_us > 0 ? t->burst_us * 5 / 4 : s->quantum_us;
+  if (base_us < q->floor_us) {
+    base_us = q->floor_us;
+  }
+
+  // a round of every ready task fits in the upper bound, so long bursts
+  // don't keep the others waiting, but no slice goes below the floor
+  long long ceiling_us = q->max_us / (s->nr_ready + 1);
+  if (ceiling_us < q->floor_us) {
+    ceiling_us = q->floor_us;
+  }
+
+  long long quantum_us = base_us * policy_us / s->quantum_us;
+  if (quantum_us > ceiling_us) {
+    quantum_us = ceiling_us;
+  }
+  if (quantum_us < q->min_us) {
+    quantum_us = q->min_us;
+  }
+  if (quantum_us > q->max_us) {
+    quantum_us = q->max_us;
+  }
+
+  ++q->slices;
+  q->total_quantum_us += quantum_us;
+  return quantum_us;
+}
+
+
+static long long thread_cpu_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
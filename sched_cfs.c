@@ -0,0 +1,148 @@
+// ./sched_cfs.c
+
+// Completely fair scheduling. Every task keeps a virtual runtime, the CPU
+// time it was measured to use (utime + stime, or taskstats) divided by its
+// weight, and the ready task with the least runs next. A task that sleeps
+// while it holds its slot leaves the CPU idle, so it is charged for the
+// slot time it held whenever that is more than the CPU it used. Under
+// --io-probe a sleeper gives its slot back and is only charged up to then.
+// Ties go to the task queued first.
+// Tasks that just arrived or slept start near the least vruntime on the
+// queue instead of at their old one, so they can neither bank idle time
+// nor starve the rest. Priorities are strict classes on top, as in stride.
+// Tasks live in a min-heap, so picking and requeueing are O(log n)
+
+#include<stdlib.h>
+#include"MCP.h"
+
+
+// Types
+
+typedef struct cfs_state {
+  task_heap ready;
+  unsigned long long min_vruntime;  // never decreases, vruntime of the last task picked
+  unsigned long long enqueues;      // enqueue count, orders tasks with equal vruntime
+} cfs_state;
+
+
+// Signatures
+
+static void cfs_enqueue(scheduler* s, task* t);
+static task* cfs_pick_next(scheduler* s, int cpu);
+static void cfs_dequeue(scheduler* s, task* t);
+static void cfs_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us);
+static long cfs_task_quantum(scheduler* s, task* t);
+static task* cfs_steal(scheduler* s, long long min_idle_us, int cpu);
+static void cfs_release(scheduler* s);
+
+// Heap order: higher priority, then lower vruntime, then queued first
+static int cfs_before(task* a, task* b);
+
+
+void cfs_init(scheduler* s) {
+  cfs_state* c = malloc(sizeof(cfs_state));
+  if (c == NULL) {
+    exit(-1);
+  }
+  heap_init(&c->ready, cfs_before);
+  c->min_vruntime = 0;
+  c->enqueues = 0;
+
+  s->name = "cfs";
+  s->data = c;
+  s->enqueue = cfs_enqueue;
+  s->pick_next = cfs_pick_next;
+  s->dequeue = cfs_dequeue;
+  s->account = cfs_account;
+  s->task_quantum = cfs_task_quantum;
+  s->steal = cfs_steal;
+  s->release = cfs_release;
+}
+
+
+static void cfs_enqueue(scheduler* s, task* t) {
+  cfs_state* c = s->data;
+
+  // at most one base quantum of credit for time spent away from the queue
+  unsigned long long credit = (unsigned long long)s->quantum_us * 1000;
+  unsigned long long floor = c->min_vruntime > credit ? c->min_vruntime - credit : 0;
+  // back from I/O, it gets all of that credit
+  if (t->pass < floor || t->boosted) {
+    t->pass = floor;
+  }
+  t->boosted = 0;
+  t->enqueue_seq = c->enqueues++;
+  heap_push(&c->ready, t);
+  ++s->nr_ready;
+}
+
+
+static task* cfs_pick_next(scheduler* s, int cpu) {
+  cfs_state* c = s->data;
+  task* t = heap_pop_allowed(&c->ready, cpu);
+  if (t == NULL) {
+    return NULL;
+  }
+
+  if (t->pass > c->min_vruntime) {
+    c->min_vruntime = t->pass;
+  }
+  --s->nr_ready;
+  return t;
+}
+
+
+static void cfs_dequeue(scheduler* s, task* t) {
+  cfs_state* c = s->data;
+  heap_remove(&c->ready, t);
+  --s->nr_ready;
+}
+
+
+static void cfs_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us) {
+  // vruntime is in nanoseconds of CPU at weight 1, a slot held while
+  // asleep counts as used since nothing else could run in it
+  double charged = cpu_used > ran_us / 1e6 ? cpu_used : ran_us / 1e6;
+  if (charged > 0) {
+    t->pass += (unsigned long long)(charged * 1e9) / t->weight;
+  }
+}
+
+
+static long cfs_task_quantum(scheduler* s, task* t) {
+  return t->quantum_us > 0 ? t->quantum_us : s->quantum_us;
+}
+
+
+static task* cfs_steal(scheduler* s, long long min_idle_us, int cpu) {
+  cfs_state* c = s->data;
+  long long now = now_us();
+
+  // leaves are furthest from their turn and lose the least by moving
+  for (int i = c->ready.size - 1; i >= 0; --i) {
+    task* t = c->ready.tasks[i];
+    if (task_allowed(t, cpu) && now - t->stopped_us >= min_idle_us) {
+      heap_remove(&c->ready, t);
+      --s->nr_ready;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+
+static void cfs_release(scheduler* s) {
+  cfs_state* c = s->data;
+  free_heap(&c->ready);
+}
+
+
+static int cfs_before(task* a, task* b) {
+  if (a->priority != b->priority) {
+    return a->priority > b->priority;
+  }
+  if (a->pass != b->pass) {
+    return a->pass < b->pass;
+  }
+  return a->enqueue_seq < b->enqueue_seq;
+}
@@ -0,0 +1,189 @@
+// ./sched_mlfq.c
+
+// Multi-level feedback queue. New tasks start at level 0 and each level
+// down gets twice the quantum of the one above it. After every slice:
+//  - a task whose rchar + wchar grew quickly is I/O-bound and moves up
+//  - a task that spent (nearly) the whole slice on the CPU, going by its
+//    utime + stime, is CPU-bound and moves down
+// Every MLFQ_BOOST_QUANTA base quanta all tasks go back to level 0 so the
+// CPU-bound ones don't starve. Boost epochs are derived from the clock, so
+// per-core instances agree on them and a stolen task keeps its level.
+// utime/stime only advance in clock ticks, so classification gets noisy
+// with quanta shorter than a few ticks
+
+#include<stdlib.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Number of priority levels
+#define MLFQ_LEVELS 4
+
+// Fraction of the slice spent on the CPU that makes a task CPU-bound
+#define MLFQ_CPU_BOUND 0.8
+
+// Bytes per second of rchar + wchar growth that makes a task I/O-bound
+#define MLFQ_IO_RATE (1024.0 * 1024.0)
+
+// Base quanta between priority boosts
+#define MLFQ_BOOST_QUANTA 20
+
+
+// Types
+
+typedef struct mlfq_state {
+  run_queue levels[MLFQ_LEVELS];
+  unsigned long epoch;          // number of boost periods since the clock started
+} mlfq_state;
+
+
+// Signatures
+
+static void mlfq_enqueue(scheduler* s, task* t);
+static task* mlfq_pick_next(scheduler* s, int cpu);
+static void mlfq_dequeue(scheduler* s, task* t);
+static void mlfq_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us);
+static long mlfq_task_quantum(scheduler* s, task* t);
+static task* mlfq_steal(scheduler* s, long long min_idle_us, int cpu);
+
+// Returns the level of 't', tasks not touched since the last boost are at level 0
+static int effective_level(mlfq_state* m, task* t);
+
+// Moves every queued task to level 0 if a boost is due
+static void maybe_boost(scheduler* s);
+
+
+void mlfq_init(scheduler* s) {
+  mlfq_state* m = malloc(sizeof(mlfq_state));
+  if (m == NULL) {
+    exit(-1);
+  }
+  for (int i = 0; i < MLFQ_LEVELS; ++i) {
+    rq_init(&m->levels[i]);
+  }
+  m->epoch = now_us() / (MLFQ_BOOST_QUANTA * s->quantum_us) + 1;
+
+  s->name = "mlfq";
+  s->data = m;
+  s->enqueue = mlfq_enqueue;
+  s->pick_next = mlfq_pick_next;
+  s->dequeue = mlfq_dequeue;
+  s->account = mlfq_account;
+  s->task_quantum = mlfq_task_quantum;
+  s->steal = mlfq_steal;
+}
+
+
+static void mlfq_enqueue(scheduler* s, task* t) {
+  mlfq_state* m = s->data;
+  t->level = effective_level(m, t);
+  t->epoch = m->epoch;
+
+  // back from I/O, to the front of the top level
+  if (t->boosted) {
+    t->level = 0;
+    rq_push_front(&m->levels[0], t);
+    t->boosted = 0;
+  }
+  else {
+    rq_push(&m->levels[t->level], t);
+  }
+  ++s->nr_ready;
+}
+
+
+static task* mlfq_pick_next(scheduler* s, int cpu) {
+  mlfq_state* m = s->data;
+  maybe_boost(s);
+
+  // highest level with a task allowed on this CPU wins
+  for (int i = 0; i < MLFQ_LEVELS; ++i) {
+    task* t = rq_first_allowed(&m->levels[i], cpu);
+    if (t != NULL) {
+      rq_remove(&m->levels[i], t);
+      --s->nr_ready;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+
+static void mlfq_dequeue(scheduler* s, task* t) {
+  mlfq_state* m = s->data;
+  rq_remove(&m->levels[effective_level(m, t)], t);
+  --s->nr_ready;
+}
+
+
+static void mlfq_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us) {
+  mlfq_state* m = s->data;
+  int level = effective_level(m, t);
+
+  if (ran_us <= 0) {
+    return;
+  }
+
+  double io_rate = io_bytes / (ran_us / 1e6);
+  if (io_rate >= MLFQ_IO_RATE) {
+    if (level > 0) {
+      --level;
+    }
+  }
+  else if (cpu_used * 1e6 >= MLFQ_CPU_BOUND * ran_us) {
+    if (level < MLFQ_LEVELS - 1) {
+      ++level;
+    }
+  }
+
+  t->level = level;
+  t->epoch = m->epoch;
+}
+
+
+static long mlfq_task_quantum(scheduler* s, task* t) {
+  // a job's own quantum from the workload scales with its level too
+  long base = t->quantum_us > 0 ? t->quantum_us : s->quantum_us;
+  return base << effective_level(s->data, t);
+}
+
+
+static task* mlfq_steal(scheduler* s, long long min_idle_us, int cpu) {
+  mlfq_state* m = s->data;
+  long long now = now_us();
+  maybe_boost(s);
+
+  // CPU-bound tasks at the bottom lose the least by moving, and each
+  // queue's head has waited longest on its level
+  for (int i = MLFQ_LEVELS - 1; i >= 0; --i) {
+    task* t = rq_first_allowed(&m->levels[i], cpu);
+    if (t != NULL && now - t->stopped_us >= min_idle_us) {
+      rq_remove(&m->levels[i], t);
+      --s->nr_ready;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+
+static int effective_level(mlfq_state* m, task* t) {
+  return t->epoch == m->epoch ? t->level : 0;
+}
+
+
+static void maybe_boost(scheduler* s) {
+  mlfq_state* m = s->data;
+  unsigned long epoch = now_us() / (MLFQ_BOOST_QUANTA * s->quantum_us) + 1;
+
+  if (epoch == m->epoch) {
+    return;
+  }
+
+  // O(1) per level, queued tasks pick up level 0 through the new epoch
+  for (int i = 1; i < MLFQ_LEVELS; ++i) {
+    rq_splice(&m->levels[0], &m->levels[i]);
+  }
+  m->epoch = epoch;
+}
@@ -0,0 +1,85 @@
+// ./sched_rr.c
+
+#include<stdlib.h>
+#include"MCP.h"
+
+
+// Signatures
+
+static void rr_enqueue(scheduler* s, task* t);
+static task* rr_pick_next(scheduler* s, int cpu);
+static void rr_dequeue(scheduler* s, task* t);
+static void rr_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us);
+static long rr_task_quantum(scheduler* s, task* t);
+static task* rr_steal(scheduler* s, long long min_idle_us, int cpu);
+
+
+void rr_init(scheduler* s) {
+  run_queue* rq = malloc(sizeof(run_queue));
+  if (rq == NULL) {
+    exit(-1);
+  }
+  rq_init(rq);
+
+  s->name = "rr";
+  s->data = rq;
+  s->enqueue = rr_enqueue;
+  s->pick_next = rr_pick_next;
+  s->dequeue = rr_dequeue;
+  s->account = rr_account;
+  s->task_quantum = rr_task_quantum;
+  s->steal = rr_steal;
+}
+
+
+static void rr_enqueue(scheduler* s, task* t) {
+  // a task back from I/O goes first, it will likely block again soon
+  if (t->boosted) {
+    rq_push_front(s->data, t);
+    t->boosted = 0;
+  }
+  else {
+    rq_push(s->data, t);
+  }
+  ++s->nr_ready;
+}
+
+
+static task* rr_pick_next(scheduler* s, int cpu) {
+  // the head unless it is pinned to other CPUs
+  task* t = rq_first_allowed(s->data, cpu);
+  if (t != NULL) {
+    rq_remove(s->data, t);
+    --s->nr_ready;
+  }
+  return t;
+}
+
+
+static void rr_dequeue(scheduler* s, task* t) {
+  rq_remove(s->data, t);
+  --s->nr_ready;
+}
+
+
+static void rr_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us) {
+  // every task gets the same turn regardless of what it did with it
+}
+
+
+static long rr_task_quantum(scheduler* s, task* t) {
+  // a job can ask for its own turn length in the workload
+  return t->quantum_us > 0 ? t->quantum_us : s->quantum_us;
+}
+
+
+static task* rr_steal(scheduler* s, long long min_idle_us, int cpu) {
+  // the head has waited longest, if it is still warm they all are
+  task* t = rq_first_allowed(s->data, cpu);
+  if (t == NULL || now_us() - t->stopped_us < min_idle_us) {
+    return NULL;
+  }
+  rq_remove(s->data, t);
+  --s->nr_ready;
+  return t;
+}
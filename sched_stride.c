@@ -0,0 +1,143 @@
+// ./sched_stride.c
+
+// Stride scheduling. Every task has a pass, and the ready task with the
+// lowest pass runs next. A slice advances the pass by the time it took
+// divided by the task's weight, so over time each task gets CPU in
+// proportion to its weight. Priorities are strict classes on top: a
+// ready task in a higher class always runs before any in a lower one.
+// Weight, priority and quantum come from the workload annotations.
+// Tasks live in a min-heap, so picking and requeueing are O(log n)
+
+#include<stdlib.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Pass advanced by a full base quantum at weight 1
+#define STRIDE_ONE (1 << 20)
+
+
+// Types
+
+typedef struct stride_state {
+  task_heap ready;
+  unsigned long long vtime;     // pass of the last task picked, new tasks start here
+} stride_state;
+
+
+// Signatures
+
+static void stride_enqueue(scheduler* s, task* t);
+static task* stride_pick_next(scheduler* s, int cpu);
+static void stride_dequeue(scheduler* s, task* t);
+static void stride_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us);
+static long stride_task_quantum(scheduler* s, task* t);
+static task* stride_steal(scheduler* s, long long min_idle_us, int cpu);
+static void stride_release(scheduler* s);
+
+// Heap order: higher priority, then lower pass, then launch order
+static int stride_before(task* a, task* b);
+
+
+void stride_init(scheduler* s) {
+  stride_state* st = malloc(sizeof(stride_state));
+  if (st == NULL) {
+    exit(-1);
+  }
+  heap_init(&st->ready, stride_before);
+  st->vtime = 0;
+
+  s->name = "stride";
+  s->data = st;
+  s->enqueue = stride_enqueue;
+  s->pick_next = stride_pick_next;
+  s->dequeue = stride_dequeue;
+  s->account = stride_account;
+  s->task_quantum = stride_task_quantum;
+  s->steal = stride_steal;
+  s->release = stride_release;
+}
+
+
+static void stride_enqueue(scheduler* s, task* t) {
+  stride_state* st = s->data;
+
+  // a new or migrated task can't bank the time before it got here, one
+  // back from I/O is put level with the furthest behind
+  if (t->pass < st->vtime || t->boosted) {
+    t->pass = st->vtime;
+  }
+  t->boosted = 0;
+  heap_push(&st->ready, t);
+  ++s->nr_ready;
+}
+
+
+static task* stride_pick_next(scheduler* s, int cpu) {
+  stride_state* st = s->data;
+  task* t = heap_pop_allowed(&st->ready, cpu);
+  if (t == NULL) {
+    return NULL;
+  }
+
+  if (t->pass > st->vtime) {
+    st->vtime = t->pass;
+  }
+  --s->nr_ready;
+  return t;
+}
+
+
+static void stride_dequeue(scheduler* s, task* t) {
+  stride_state* st = s->data;
+  heap_remove(&st->ready, t);
+  --s->nr_ready;
+}
+
+
+static void stride_account(scheduler* s, task* t, double cpu_used, unsigned long io_bytes, long ran_us) {
+  // charge the slot time, a task that blocks still held the slot
+  if (ran_us > 0) {
+    t->pass += (unsigned long long)ran_us * STRIDE_ONE / ((unsigned long long)s->quantum_us * t->weight);
+  }
+}
+
+
+static long stride_task_quantum(scheduler* s, task* t) {
+  return t->quantum_us > 0 ? t->quantum_us : s->quantum_us;
+}
+
+
+static task* stride_steal(scheduler* s, long long min_idle_us, int cpu) {
+  stride_state* st = s->data;
+  long long now = now_us();
+
+  // leaves are furthest from their turn and lose the least by moving
+  for (int i = st->ready.size - 1; i >= 0; --i) {
+    task* t = st->ready.tasks[i];
+    if (task_allowed(t, cpu) && now - t->stopped_us >= min_idle_us) {
+      heap_remove(&st->ready, t);
+      --s->nr_ready;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+
+static void stride_release(scheduler* s) {
+  stride_state* st = s->data;
+  free_heap(&st->ready);
+}
+
+
+static int stride_before(task* a, task* b) {
+  if (a->priority != b->priority) {
+    return a->priority > b->priority;
+  }
+  if (a->pass != b->pass) {
+    return a->pass < b->pass;
+  }
+  return a->index < b->index;
+}
@@ -0,0 +1,193 @@
+// ./trace.c
+
+// Binary trace of scheduling events. The MCP appends fixed-size records
+// to a single-producer ring in memory, which costs a few stores and no
+// syscall, and a flusher thread writes them out behind it:
+//  - the MCP pokes an eventfd once the ring is half full, otherwise the
+//    thread wakes up every TRACE_FLUSH_MS on its own
+//  - head and tail are the only shared state, each written by one side
+//  - a full ring drops events rather than stall the scheduler, the count
+//    of dropped events goes in the header when the trace is closed, along
+//    with any the flusher couldn't write
+// The file is a trace_header followed by trace_events in order, see
+// trace_export.c for reading it
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stddef.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<unistd.h>
+#include<sys/eventfd.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Events held in memory, a power of two so the index is a mask
+#define TRACE_RING_SIZE (1 << 16)
+
+// Longest the flusher sleeps while the ring is less than half full
+#define TRACE_FLUSH_MS 100
+
+
+// Signatures
+
+// Writes everything between the tail and the head to the file
+static void trace_drain();
+
+// Body of the flusher thread
+static void* trace_flusher(void* arg);
+
+
+// Globals
+
+// Ring shared with the flusher, only the MCP advances 'head' and only
+// the flusher advances 'tail'
+static trace_event* ring = NULL;
+static atomic_ulong head = 0;
+static atomic_ulong tail = 0;
+static atomic_int stopping = 0;
+
+static int trace_fd = -1;
+static int wake_fd = -1;
+static pthread_t flusher;
+static int flusher_running = 0;
+static unsigned long long dropped = 0;
+
+// Events the flusher couldn't write, only it touches these until the join
+static unsigned long long lost = 0;
+static int write_failed = 0;
+
+
+int trace_open(const char* path) {
+  ring = malloc(sizeof(trace_event) * TRACE_RING_SIZE);
+  trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (ring == NULL || trace_fd == -1 || wake_fd == -1) {
+    trace_close();
+    return -1;
+  }
+
+  trace_header header = {{'M', 'C', 'P', 'T'}, TRACE_VERSION, sizeof(trace_event), 0, 0};
+  if (write(trace_fd, &header, sizeof(header)) != sizeof(header) ||
+      pthread_create(&flusher, NULL, trace_flusher, NULL) != 0) {
+    trace_close();
+    return -1;
+  }
+  flusher_running = 1;
+  return 0;
+}
+
+
+unsigned long long trace_close() {
+  if (ring == NULL) {
+    return 0;
+  }
+
+  // the flusher writes whatever is left before it returns
+  if (flusher_running) {
+    atomic_store(&stopping, 1);
+    uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+    pthread_join(flusher, NULL);
+    dropped += lost;
+    pwrite(trace_fd, &dropped, sizeof(dropped), offsetof(trace_header, dropped));
+    flusher_running = 0;
+  }
+
+  if (trace_fd != -1) {
+    close(trace_fd);
+  }
+  if (wake_fd != -1) {
+    close(wake_fd);
+  }
+  free(ring);
+  ring = NULL;
+  trace_fd = -1;
+  wake_fd = -1;
+  return dropped;
+}
+
+
+void trace_emit(trace_type type, pid_t pid, int slot, long long value) {
+  if (ring == NULL) {
+    return;
+  }
+
+  unsigned long h = atomic_load_explicit(&head, memory_order_relaxed);
+  unsigned long used = h - atomic_load_explicit(&tail, memory_order_acquire);
+  if (used == TRACE_RING_SIZE) {
+    ++dropped;
+    return;
+  }
+
+  trace_event* ev = &ring[h & (TRACE_RING_SIZE - 1)];
+  ev->time_us = now_us();
+  ev->value = value;
+  ev->pid = pid;
+  ev->type = type;
+  ev->slot = slot;
+  atomic_store_explicit(&head, h + 1, memory_order_release);
+
+  // once per crossing, not once per event
+  if (used + 1 == TRACE_RING_SIZE / 2) {
+    uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+  }
+}
+
+
+static void trace_drain() {
+  unsigned long t = atomic_load_explicit(&tail, memory_order_relaxed);
+  unsigned long h = atomic_load_explicit(&head, memory_order_acquire);
+
+  // at most two writes, the part before the end of the ring and the wrap
+  while (t != h) {
+    unsigned long start = t & (TRACE_RING_SIZE - 1);
+    unsigned long count = h - t;
+    if (start + count > TRACE_RING_SIZE) {
+      count = TRACE_RING_SIZE - start;
+    }
+
+    // a short write goes on from where it stopped, a failed one gives up
+    // on the file and the rest of the trace is counted as lost
+    char* data = (char*)&ring[start];
+    size_t len = write_failed ? 0 : count * sizeof(trace_event);
+    size_t done = 0;
+    while (done < len) {
+      ssize_t n = write(trace_fd, data + done, len - done);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        write_failed = 1;
+        break;
+      }
+      done += n;
+    }
+    // a record cut short is dropped by the reader along with the rest
+    lost += count - done / sizeof(trace_event);
+    t += count;
+    atomic_store_explicit(&tail, t, memory_order_release);
+  }
+}
+
+
+static void* trace_flusher(void* arg) {
+  struct pollfd pfd = {wake_fd, POLLIN, 0};
+
+  while (!atomic_load(&stopping)) {
+    if (poll(&pfd, 1, TRACE_FLUSH_MS) > 0) {
+      uint64_t count;
+      read(wake_fd, &count, sizeof(count));
+    }
+    trace_drain();
+  }
+  trace_drain();
+  return NULL;
+}
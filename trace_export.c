@@ -0,0 +1,369 @@
+// ./trace_export.c
+
+// Reads a trace written by part4 --trace and turns it into
+//  - Chrome trace JSON (chrome://tracing or Perfetto), one track per slot
+//    with a box for every slice a job ran, and instants for spawns,
+//    blocks, parks, wakes and exits
+//  - a text Gantt chart, one row per job: '#' running, '.' waiting
+// Both are built in a single pass over the events, jobs are found by pid
+// through a hash since a 10k-job trace recycles pids
+
+
+// Imports
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<getopt.h>
+#include"MCP.h"
+
+
+// Constants
+
+// Default width of the Gantt chart in columns
+#define GANTT_WIDTH 100
+
+
+// Types
+
+// What the trace says about one job
+typedef struct job_record {
+  pid_t pid;
+  int index;                // line number from the spawn event
+  long long spawn_us;
+  long long exit_us;        // -1 while alive
+  long long run_start_us;   // -1 while not running
+  int slot;                 // slot it's running on
+  long long run_us;         // total time holding a slot
+  int dispatches;
+  char* row;                // Gantt row, NULL without --gantt
+} job_record;
+
+
+// Signatures
+
+// Prints usage text
+void usage(const char* cmd_name);
+
+// Reads every event of the trace at 'path', returns the count or -1
+long read_trace(const char* path, trace_event** events, trace_header* header);
+
+// Returns the job currently using 'pid', NULL if none was spawned with it
+job_record* find_job(pid_t pid);
+
+// Starts a new job for a spawn event, replacing any earlier job with the same pid
+job_record* add_job(trace_event* ev);
+
+// Ends the running slice of 'job' at 'time_us'
+void end_slice(job_record* job, long long time_us);
+
+// Marks columns of a Gantt row covering [start_us, end_us) with 'mark', keeping '#' over '.'
+void fill_row(char* row, long long start_us, long long end_us, char mark);
+
+
+// Globals
+
+job_record* jobs = NULL;
+int num_jobs = 0;
+int jobs_cap = 0;
+
+// pid -> index into 'jobs' + 1, open addressing, 0 is empty
+int* job_hash = NULL;
+int hash_size = 0;
+
+// Time range of the trace and the Gantt columns over it
+long long first_us = 0;
+long long span_us = 1;
+int gantt_width = 0;
+
+// Chrome trace output, NULL without --chrome
+FILE* chrome = NULL;
+int chrome_events = 0;
+
+
+int main(int argc, char const *argv[]) {
+  const char* chrome_path = NULL;
+  int gantt = 0;
+  int width = GANTT_WIDTH;
+  static struct option long_options[] = {
+    {"chrome", required_argument, NULL, 'c'},
+    {"gantt",  no_argument,       NULL, 'g'},
+    {"width",  required_argument, NULL, 'w'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+
+  while ((opt = getopt_long(argc, (char* const*)argv, "c:gw:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'c':
+        chrome_path = optarg;
+        break;
+      case 'g':
+        gantt = 1;
+        break;
+      case 'w':
+        width = atoi(optarg);
+        if (width < 1) {
+          usage(argv[0]);
+          return 0;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 0;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 0;
+  }
+
+  trace_event* events;
+  trace_header header;
+  long num_events = read_trace(argv[optind], &events, &header);
+  if (num_events == -1) {
+    return 1;
+  }
+  if (num_events > 0) {
+    first_us = events[0].time_us;
+    span_us = events[num_events - 1].time_us - first_us + 1;
+  }
+  gantt_width = gantt ? width : 0;
+
+  if (chrome_path != NULL) {
+    chrome = fopen(chrome_path, "w");
+    if (chrome == NULL) {
+      fprintf(stderr, "can't write '%s'\n", chrome_path);
+      return 1;
+    }
+    fprintf(chrome, "{\"traceEvents\": [\n");
+  }
+
+  // one pass, a slice runs from its dispatch to the preempt or exit after it
+  int max_slot = -1;
+  for (long i = 0; i < num_events; ++i) {
+    trace_event* ev = &events[i];
+    job_record* job = ev->type == TRACE_SPAWN ? add_job(ev) : find_job(ev->pid);
+    if (job == NULL) {
+      continue;
+    }
+    if (ev->slot > max_slot) {
+      max_slot = ev->slot;
+    }
+
+    const char* instant = NULL;
+    switch (ev->type) {
+      case TRACE_SPAWN:
+        instant = "spawn";
+        break;
+      case TRACE_DISPATCH:
+        end_slice(job, ev->time_us);
+        job->run_start_us = ev->time_us;
+        job->slot = ev->slot;
+        ++job->dispatches;
+        break;
+      case TRACE_PREEMPT:
+        end_slice(job, ev->time_us);
+        break;
+      case TRACE_PARK:
+        end_slice(job, ev->time_us);
+        instant = "park";
+        break;
+      case TRACE_WAKE:
+        instant = "wake";
+        break;
+      case TRACE_BLOCK:
+        instant = "block";
+        break;
+      case TRACE_EXIT:
+        end_slice(job, ev->time_us);
+        job->exit_us = ev->time_us;
+        instant = "exit";
+        break;
+      default:
+        break;
+    }
+
+    if (chrome != NULL && instant != NULL) {
+      fprintf(chrome, "%s{\"name\": \"%s %d\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %lld, \"pid\": 0, \"tid\": %d}",
+        chrome_events++ > 0 ? ",\n" : "", instant, ev->pid, ev->time_us - first_us, ev->slot < 0 ? 0 : ev->slot);
+    }
+  }
+
+  // jobs still running when the trace ended
+  long long end_us = first_us + span_us;
+  for (int i = 0; i < num_jobs; ++i) {
+    end_slice(&jobs[i], end_us);
+  }
+
+  if (chrome != NULL) {
+    for (int slot = 0; slot <= max_slot; ++slot) {
+      fprintf(chrome, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"slot %d\"}}",
+        chrome_events++ > 0 ? ",\n" : "", slot, slot);
+    }
+    fprintf(chrome, "\n]}\n");
+    fclose(chrome);
+  }
+
+  printf("%ld events, %llu dropped, %d jobs over %.3f s\n",
+    num_events, (unsigned long long)header.dropped, num_jobs, span_us / 1e6);
+
+  if (gantt) {
+    printf("one column = %.3f ms, '#' running, '.' waiting\n", span_us / 1e3 / gantt_width);
+    printf("%6s %8s %9s %5s |\n", "JOB", "PID", "RUN MS", "RUNS");
+    for (int i = 0; i < num_jobs; ++i) {
+      job_record* job = &jobs[i];
+      long long exit_us = job->exit_us == -1 ? end_us : job->exit_us;
+      fill_row(job->row, job->spawn_us, exit_us, '.');
+      printf("%6d %8d %9.1f %5d |%s|\n", job->index, job->pid, job->run_us / 1e3, job->dispatches, job->row);
+      free(job->row);
+    }
+  }
+
+  free(jobs);
+  free(job_hash);
+  free(events);
+  return 0;
+}
+
+
+void usage(const char* cmd_name) {
+  printf("Usage:\n\t%s [--chrome <JSON>] [--gantt] [--width <N>] <TRACE>\n\n"
+         "\t<TRACE>: file written by part4 --trace\n"
+         "\t--chrome <JSON>: write the slices as Chrome trace JSON, for chrome://tracing or Perfetto\n"
+         "\t--gantt: print a text Gantt chart with a row per job\n"
+         "\t--width <N>: columns in the Gantt chart (default %d)\n",
+         cmd_name, GANTT_WIDTH);
+}
+
+
+long read_trace(const char* path, trace_event** events, trace_header* header) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "can't open '%s'\n", path);
+    return -1;
+  }
+
+  if (fread(header, sizeof(*header), 1, file) != 1 || memcmp(header->magic, "MCPT", 4) != 0 ||
+      header->version != TRACE_VERSION || header->event_size != sizeof(trace_event)) {
+    fprintf(stderr, "'%s' is not a trace from this version of part4\n", path);
+    fclose(file);
+    return -1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long num_events = (ftell(file) - (long)sizeof(*header)) / sizeof(trace_event);
+  fseek(file, sizeof(*header), SEEK_SET);
+
+  *events = malloc(sizeof(trace_event) * (num_events > 0 ? num_events : 1));
+  if (*events == NULL || (long)fread(*events, sizeof(trace_event), num_events, file) != num_events) {
+    fprintf(stderr, "can't read '%s'\n", path);
+    free(*events);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  return num_events;
+}
+
+
+job_record* find_job(pid_t pid) {
+  if (hash_size == 0) {
+    return NULL;
+  }
+  for (int i = pid & (hash_size - 1); job_hash[i] != 0; i = (i + 1) & (hash_size - 1)) {
+    if (jobs[job_hash[i] - 1].pid == pid) {
+      return &jobs[job_hash[i] - 1];
+    }
+  }
+  return NULL;
+}
+
+
+job_record* add_job(trace_event* ev) {
+  if (num_jobs == jobs_cap) {
+    jobs_cap = jobs_cap > 0 ? jobs_cap * 2 : 256;
+    jobs = realloc(jobs, sizeof(job_record) * jobs_cap);
+    if (jobs == NULL) {
+      exit(-1);
+    }
+  }
+
+  // keep the hash at most half full, rebuilding it from the job list
+  if ((num_jobs + 1) * 2 > hash_size) {
+    hash_size = hash_size > 0 ? hash_size * 2 : 512;
+    free(job_hash);
+    job_hash = calloc(hash_size, sizeof(int));
+    if (job_hash == NULL) {
+      exit(-1);
+    }
+    for (int j = 0; j < num_jobs; ++j) {
+      int i = jobs[j].pid & (hash_size - 1);
+      while (job_hash[i] != 0 && jobs[job_hash[i] - 1].pid != jobs[j].pid) {
+        i = (i + 1) & (hash_size - 1);
+      }
+      job_hash[i] = j + 1;
+    }
+  }
+
+  job_record* job = &jobs[num_jobs++];
+  job->pid = ev->pid;
+  job->index = ev->value;
+  job->spawn_us = ev->time_us;
+  job->exit_us = -1;
+  job->run_start_us = -1;
+  job->slot = -1;
+  job->run_us = 0;
+  job->dispatches = 0;
+  job->row = NULL;
+  if (gantt_width > 0) {
+    job->row = malloc(gantt_width + 1);
+    if (job->row == NULL) {
+      exit(-1);
+    }
+    memset(job->row, ' ', gantt_width);
+    job->row[gantt_width] = '\0';
+  }
+
+  // a recycled pid takes over the slot of the job that had it
+  int i = job->pid & (hash_size - 1);
+  while (job_hash[i] != 0 && jobs[job_hash[i] - 1].pid != job->pid) {
+    i = (i + 1) & (hash_size - 1);
+  }
+  job_hash[i] = num_jobs;
+  return job;
+}
+
+
+void end_slice(job_record* job, long long time_us) {
+  if (job->run_start_us == -1) {
+    return;
+  }
+
+  job->run_us += time_us - job->run_start_us;
+  if (job->row != NULL) {
+    fill_row(job->row, job->run_start_us, time_us, '#');
+  }
+  if (chrome != NULL) {
+    fprintf(chrome, "%s{\"name\": \"job %d (%d)\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": 0, \"tid\": %d}",
+      chrome_events++ > 0 ? ",\n" : "", job->index, job->pid,
+      job->run_start_us - first_us, time_us - job->run_start_us, job->slot);
+  }
+  job->run_start_us = -1;
+}
+
+
+void fill_row(char* row, long long start_us, long long end_us, char mark) {
+  int first = (start_us - first_us) * gantt_width / span_us;
+  int last = (end_us - first_us) * gantt_width / span_us;
+  if (last >= gantt_width) {
+    last = gantt_width - 1;
+  }
+
+  // a slice shorter than a column still shows up
+  for (int i = first; i <= last; ++i) {
+    if (row[i] != '#') {
+      row[i] = mark;
+    }
+  }
+}
@@ -0,0 +1,99 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Writes a mixed benchmark workload for part4 to stdout, one benchjob
+ * line per job, in a shuffled order that only depends on -seed:
+ *  -cpu N     CPU-bound, 200-600 ms of CPU
+ *  -io N      I/O-bound, 200-400 synced 4 KiB writes
+ *  -bursty N  5-10 rounds of 10-30 ms of CPU and 50 ms asleep
+ *  -short N   short-lived, 1-10 ms of CPU
+ *  -phased N  two rounds of a 150 ms CPU phase then 150 synced writes
+ */
+
+/* Kinds of job, in the order of the flags above */
+enum { CPU_JOB, IO_JOB, BURSTY_JOB, SHORT_JOB, PHASED_JOB, NUM_KINDS };
+
+static const char *flags[NUM_KINDS] = {"-cpu", "-io", "-bursty", "-short", "-phased"};
+
+/* Returns a number in [low, high] */
+static int pick(int low, int high) {
+    return low + rand() % (high - low + 1);
+}
+
+int main(int argc, char **argv) {
+    int counts[NUM_KINDS] = {4, 4, 4, 16, 2};
+    int i, k, total = 0;
+    unsigned int seed = 1;
+    int *jobs;
+
+/*
+ * process command line arguments, every flag takes a value
+ */
+    for (i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for `%s'\n", argv[i]);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-seed") == 0) {
+            seed = atoi(argv[i + 1]);
+            continue;
+        }
+        for (k = 0; k < NUM_KINDS && strcmp(argv[i], flags[k]) != 0; k++) {
+        }
+        if (k == NUM_KINDS) {
+            fprintf(stderr, "Illegal flag: `%s'\n", argv[i]);
+            exit(1);
+        }
+        counts[k] = atoi(argv[i + 1]);
+    }
+
+    for (k = 0; k < NUM_KINDS; k++) {
+        total += counts[k];
+    }
+    jobs = malloc(sizeof(int) * (total > 0 ? total : 1));
+    if (jobs == NULL) {
+        exit(1);
+    }
+    for (k = 0, i = 0; k < NUM_KINDS; k++) {
+        int n;
+        for (n = 0; n < counts[k]; n++) {
+            jobs[i++] = k;
+        }
+    }
+
+/*
+ * Fisher-Yates, so arrival order doesn't favour any kind
+ */
+    srand(seed);
+    for (i = total - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int swap = jobs[i];
+        jobs[i] = jobs[j];
+        jobs[j] = swap;
+    }
+
+    for (i = 0; i < total; i++) {
+        switch (jobs[i]) {
+            case CPU_JOB:
+                printf("./benchjob -cpu %d\n", pick(200, 600));
+                break;
+            case IO_JOB:
+                printf("./benchjob -io %d\n", pick(200, 400));
+                break;
+            case BURSTY_JOB:
+                printf("./benchjob -cpu %d -sleep 50 -repeat %d\n", pick(10, 30), pick(5, 10));
+                break;
+            case SHORT_JOB:
+                printf("./benchjob -cpu %d\n", pick(1, 10));
+                break;
+            case PHASED_JOB:
+                printf("./benchjob -cpu 150 -io 150 -repeat 2\n");
+                break;
+        }
+    }
+
+    free(jobs);
+    return 0;
+}